@@ -0,0 +1,264 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @class ResponseCache
+ * @brief Sharded in-memory cache of fully serialized responses
+ *
+ * Keys are grouped by request path: a path and all of its variants (negotiated
+ * encoding, connection handling) live in the same shard, so they can be
+ * invalidated together. Each shard evicts least-recently-used entries once it
+ * exceeds its share of the byte budget. Concurrent misses on the same key are
+ * coalesced: one caller computes the response and the others wait for it.
+ * A computation that an invalidate() overtakes is still returned to its
+ * callers but not stored, and later misses don't wait on it.
+ */
+class ResponseCache {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Bytes = std::shared_ptr<const std::string>;
+
+    /**
+     * @brief Result of computing a response on a miss
+     */
+    struct Computed {
+        Bytes bytes;
+        bool cacheable;
+    };
+
+    /**
+     * @param byte_budget Total bytes of serialized responses the cache may hold
+     * @param shard_count Number of independently locked shards
+     */
+    explicit ResponseCache(size_t byte_budget, size_t shard_count = 16)
+        : shards_(shard_count)
+        , shard_budget_(byte_budget / shard_count)
+    {}
+
+    /**
+     * @brief Builds the cache key for one variant of a path
+     */
+    static std::string makeKey(const std::string& path, const std::string& encoding, bool close_connection) {
+        std::string key;
+        key.reserve(path.size() + encoding.size() + 8);
+        key.append(path).append(1, kKeySeparator).append(encoding);
+        if (close_connection) {
+            key.append(1, kKeySeparator).append("close");
+        }
+        return key;
+    }
+
+    /**
+     * @brief Whether a response of this size could be stored at all
+     *
+     * Lets callers skip serializing responses the cache would only throw away.
+     */
+    [[nodiscard]] bool admits(size_t bytes) const {
+        return bytes <= maxEntryBytes();
+    }
+
+    /**
+     * @brief Returns the cached response for key, computing it on a miss
+     *
+     * @param path Request path the key was built from; selects the shard
+     * @param key Full cache key from makeKey()
+     * @param ttl How long a computed response stays fresh
+     * @param compute Produces the serialized response; only cacheable results are stored.
+     *        It may return null bytes for a response it declines to share.
+     * @return Bytes The serialized response, shared with the cache, or null if the
+     *         computation declined or failed; a caller that was waiting on another
+     *         caller's computation then has to produce the response itself
+     */
+    Bytes getOrCompute(const std::string& path, const std::string& key, Clock::duration ttl,
+                       const std::function<Computed()>& compute) {
+        Shard& shard = shardFor(path);
+        std::shared_future<Bytes> pending;
+        std::promise<Bytes> promise;
+        uint64_t generation;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            generation = shard.generation;
+            const auto it = shard.entries.find(key);
+            if (it != shard.entries.end()) {
+                if (it->second.expires_at > Clock::now()) {
+                    shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru_position);
+                    hits_.fetch_add(1, std::memory_order_relaxed);
+                    return it->second.bytes;
+                }
+                expirations_.fetch_add(1, std::memory_order_relaxed);
+                erase(shard, it);
+            }
+
+            const auto in_flight = shard.in_flight.find(key);
+            if (in_flight != shard.in_flight.end() && in_flight->second.generation == generation) {
+                pending = in_flight->second.result;
+            } else {
+                // A computation started before the last invalidate() may be stale; replace it
+                shard.in_flight.insert_or_assign(key, InFlight{promise.get_future().share(), generation});
+            }
+        }
+
+        if (pending.valid()) {
+            coalesced_.fetch_add(1, std::memory_order_relaxed);
+            return pending.get();
+        }
+
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        Computed computed;
+        try {
+            computed = compute();
+        } catch (...) {
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                finishInFlight(shard, key, generation);
+            }
+            // Only the computing caller sees the exception; waiters fall back to computing themselves
+            promise.set_value(nullptr);
+            throw;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            finishInFlight(shard, key, generation);
+            if (computed.cacheable && computed.bytes && admits(computed.bytes->size())
+                && shard.generation == generation) {
+                insert(shard, key, computed.bytes, Clock::now() + ttl);
+            }
+        }
+        promise.set_value(computed.bytes);
+        return computed.bytes;
+    }
+
+    /**
+     * @brief Drops every cached variant of a path
+     *
+     * Responses still being computed for the shard may predate the change, so
+     * they are kept out of the cache too.
+     */
+    void invalidate(const std::string& path) {
+        Shard& shard = shardFor(path);
+        const std::string prefix = path + kKeySeparator;
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.generation++;
+        auto it = shard.entries.lower_bound(prefix);
+        while (it != shard.entries.end() && it->first.starts_with(prefix)) {
+            it = erase(shard, it);
+        }
+    }
+
+    /**
+     * @brief Renders the cache counters as "name value" lines
+     */
+    [[nodiscard]] std::string statsText() {
+        size_t bytes = 0;
+        size_t entries = 0;
+        for (Shard& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            bytes += shard.bytes;
+            entries += shard.entries.size();
+        }
+
+        std::ostringstream out;
+        out << "response_cache_hits " << hits_.load(std::memory_order_relaxed) << '\n'
+            << "response_cache_misses " << misses_.load(std::memory_order_relaxed) << '\n'
+            << "response_cache_coalesced " << coalesced_.load(std::memory_order_relaxed) << '\n'
+            << "response_cache_expirations " << expirations_.load(std::memory_order_relaxed) << '\n'
+            << "response_cache_evictions " << evictions_.load(std::memory_order_relaxed) << '\n'
+            << "response_cache_entries " << entries << '\n'
+            << "response_cache_bytes " << bytes << '\n';
+        return out.str();
+    }
+
+private:
+    static constexpr char kKeySeparator = '\n';
+
+    struct Entry {
+        Bytes bytes;
+        Clock::time_point expires_at;
+        std::list<std::string>::iterator lru_position;
+    };
+
+    struct InFlight {
+        std::shared_future<Bytes> result;
+        uint64_t generation; ///< Shard generation when the computation started
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        // Ordered so all variants of a path are adjacent for invalidate()
+        std::map<std::string, Entry> entries;
+        std::list<std::string> lru; // Most recently used first
+        std::unordered_map<std::string, InFlight> in_flight;
+        size_t bytes = 0;
+        // Bumped by invalidate(); per shard rather than per path, so an invalidation
+        // may also keep an unrelated path's response out of the cache once
+        uint64_t generation = 0;
+    };
+
+    std::vector<Shard> shards_;
+    size_t shard_budget_;
+
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> coalesced_{0};
+    std::atomic<uint64_t> expirations_{0};
+    std::atomic<uint64_t> evictions_{0};
+
+    [[nodiscard]] size_t maxEntryBytes() const {
+        // One entry may take at most a quarter of its shard so it can't flush the rest
+        return shard_budget_ / 4;
+    }
+
+    Shard& shardFor(const std::string& path) {
+        return shards_[std::hash<std::string>{}(path) % shards_.size()];
+    }
+
+    /**
+     * @brief Unregisters a finished computation unless a newer one has replaced it
+     */
+    static void finishInFlight(Shard& shard, const std::string& key, uint64_t generation) {
+        const auto it = shard.in_flight.find(key);
+        if (it != shard.in_flight.end() && it->second.generation == generation) {
+            shard.in_flight.erase(it);
+        }
+    }
+
+    static std::map<std::string, Entry>::iterator erase(Shard& shard, std::map<std::string, Entry>::iterator it) {
+        shard.bytes -= it->second.bytes->size();
+        shard.lru.erase(it->second.lru_position);
+        return shard.entries.erase(it);
+    }
+
+    void insert(Shard& shard, const std::string& key, Bytes bytes, Clock::time_point expires_at) {
+        const auto existing = shard.entries.find(key);
+        if (existing != shard.entries.end()) {
+            erase(shard, existing);
+        }
+
+        shard.bytes += bytes->size();
+        shard.lru.push_front(key);
+        shard.entries.emplace(key, Entry{std::move(bytes), expires_at, shard.lru.begin()});
+
+        while (shard.bytes > shard_budget_ && !shard.lru.empty()) {
+            erase(shard, shard.entries.find(shard.lru.back()));
+            evictions_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+};
+
+#endif //RESPONSE_CACHE_H
@@ -0,0 +1,356 @@
+#ifndef SERVER_CONFIG_H
+#define SERVER_CONFIG_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/socket.h>
+
+/**
+ * @brief An address the server listens on
+ */
+struct ListenAddress {
+    std::string host;
+    int port;
+};
+
+/**
+ * @struct ServerConfig
+ * @brief Runtime configuration, read from an optional config file and the command line
+ *
+ * Every option can be given on the command line as "--<key> <value>" or in the
+ * file named by "--config" as "<key> = <value>" (blank lines and '#' comments are
+ * ignored). Command-line values override the file. Sizes accept k/m/g suffixes.
+ * Options left at 0 are sized automatically from the host by autoSize().
+ */
+struct ServerConfig {
+    // Listening
+    std::vector<ListenAddress> listen = {{"0.0.0.0", 4221}};
+    int backlog = 0;
+    size_t acceptor_threads = 0;
+
+    // Request processing
+    size_t worker_threads = 0;
+    size_t max_header_bytes = 64 * 1024;
+    size_t max_body_bytes = 0;
+    size_t buffer_pool_bytes = 0;
+    int idle_timeout_ms = 60000;
+    int io_timeout_ms = 30000;
+
+    // Compression policy
+    bool compression = true;
+    int compression_level = 9;
+    size_t compression_min_bytes = 0;
+
+    // Routes and subsystems
+    std::string directory;
+    std::vector<std::string> proxies;
+    std::string proxy_balance = "round-robin";
+    bool durable_writes = false;
+    long group_commit_window_us = 2000;
+    std::string group_commit_sync = "fdatasync";
+    uint32_t trace_sample = 0;
+
+    // Response cache: disabled while cache_bytes is 0; cache_routes holds "<route>=<ttl-ms>"
+    size_t cache_bytes = 0;
+    std::vector<std::string> cache_routes;
+
+    /**
+     * @brief Builds the configuration from the command line and any file it names
+     * @throws std::invalid_argument on unknown options or malformed values
+     */
+    static ServerConfig load(int argc, char **argv) {
+        ServerConfig config;
+        std::vector<std::pair<std::string, std::string>> arguments;
+        for (int i = 1; i < argc; i += 2) {
+            const std::string flag = argv[i];
+            if (!flag.starts_with("--") || i + 1 >= argc) {
+                throw std::invalid_argument("Expected --<option> <value>, got '" + flag + "'");
+            }
+            arguments.emplace_back(flag.substr(2), argv[i + 1]);
+        }
+
+        for (const auto &[key, value] : arguments) {
+            if (key == "config") {
+                config.loadFile(value);
+            }
+        }
+
+        std::set<std::string> lists_seen;
+        for (const auto &[key, value] : arguments) {
+            if (key != "config") {
+                config.set(key, value, lists_seen);
+            }
+        }
+
+        config.autoSize();
+        return config;
+    }
+
+    /**
+     * @brief Fills every option left at 0 from the host's cores, somaxconn and memory
+     */
+    void autoSize() {
+        const size_t cores = std::max(1u, std::thread::hardware_concurrency());
+
+        if (backlog == 0) {
+            // The kernel silently caps the backlog at somaxconn, so ask for exactly that
+            backlog = static_cast<int>(readProcNumber("/proc/sys/net/core/somaxconn", SOMAXCONN));
+        }
+        if (worker_threads == 0) {
+            // A worker is held for the lifetime of a keep-alive connection and mostly
+            // blocks on I/O, so run several per core
+            worker_threads = std::max<size_t>(8, cores * 4);
+        }
+        if (acceptor_threads == 0) {
+            acceptor_threads = std::clamp<size_t>(cores / 8, 1, 4);
+        }
+
+        const size_t memory = availableMemory();
+        if (max_body_bytes == 0) {
+            // Every worker buffering a maximal body at once stays within a quarter of memory
+            max_body_bytes = std::clamp<size_t>(memory / 4 / worker_threads, 1 << 20, 64 << 20);
+        }
+        if (buffer_pool_bytes == 0) {
+            buffer_pool_bytes = std::clamp<size_t>(memory / 64, 4 << 20, 256 << 20);
+        }
+    }
+
+    /**
+     * @brief Renders the effective configuration, one "key = value" line per option
+     */
+    [[nodiscard]] std::string describe() const {
+        std::ostringstream out;
+        out << "Effective configuration:\n";
+        for (const ListenAddress &address : listen) {
+            out << "  listen = " << address.host << ':' << address.port << '\n';
+        }
+        out << "  backlog = " << backlog << '\n'
+            << "  acceptors = " << acceptor_threads << '\n'
+            << "  workers = " << worker_threads << '\n'
+            << "  max-header-bytes = " << max_header_bytes << '\n'
+            << "  max-body-bytes = " << max_body_bytes << '\n'
+            << "  buffer-pool-bytes = " << buffer_pool_bytes << '\n'
+            << "  idle-timeout-ms = " << idle_timeout_ms << '\n'
+            << "  io-timeout-ms = " << io_timeout_ms << '\n'
+            << "  compression = " << (compression ? "gzip" : "off") << '\n'
+            << "  compression-level = " << compression_level << '\n'
+            << "  compression-min-bytes = " << compression_min_bytes << '\n'
+            << "  directory = " << directory << '\n';
+        for (const std::string &proxy : proxies) {
+            out << "  proxy = " << proxy << '\n';
+        }
+        out << "  proxy-balance = " << proxy_balance << '\n'
+            << "  durable-writes = " << (durable_writes ? "true" : "false") << '\n'
+            << "  group-commit-window-us = " << group_commit_window_us << '\n'
+            << "  group-commit-sync = " << group_commit_sync << '\n'
+            << "  trace-sample = " << trace_sample << '\n'
+            << "  cache-bytes = " << cache_bytes << '\n';
+        for (const std::string &route : cache_routes) {
+            out << "  cache-route = " << route << '\n';
+        }
+        return out.str();
+    }
+
+private:
+    void loadFile(const std::string &path) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            throw std::invalid_argument("Cannot open config file " + path);
+        }
+
+        std::set<std::string> lists_seen;
+        std::string line;
+        int line_number = 0;
+        while (std::getline(file, line)) {
+            line_number++;
+            line = trim(line.substr(0, line.find('#')));
+            if (line.empty()) {
+                continue;
+            }
+            const size_t eq = line.find('=');
+            if (eq == std::string::npos) {
+                throw std::invalid_argument(path + ":" + std::to_string(line_number) + ": expected <key> = <value>");
+            }
+            set(trim(line.substr(0, eq)), trim(line.substr(eq + 1)), lists_seen);
+        }
+    }
+
+    /**
+     * @brief Applies one option
+     * @param lists_seen List options already set by the current source; the first
+     *        occurrence in a source replaces values from the defaults or an earlier source
+     */
+    void set(const std::string &key, const std::string &value, std::set<std::string> &lists_seen) {
+        const bool first_in_source = lists_seen.insert(key).second;
+
+        if (key == "listen") {
+            if (first_in_source) {
+                listen.clear();
+            }
+            listen.push_back(parseListenAddress(value));
+        } else if (key == "backlog") {
+            backlog = parseNumber<int>(key, value);
+        } else if (key == "acceptors") {
+            acceptor_threads = parseSize(key, value);
+        } else if (key == "workers") {
+            worker_threads = parseSize(key, value);
+        } else if (key == "max-header-bytes") {
+            max_header_bytes = parseSize(key, value);
+        } else if (key == "max-body-bytes") {
+            max_body_bytes = parseSize(key, value);
+        } else if (key == "buffer-pool-bytes") {
+            buffer_pool_bytes = parseSize(key, value);
+        } else if (key == "idle-timeout-ms") {
+            idle_timeout_ms = parseNumber<int>(key, value);
+        } else if (key == "io-timeout-ms") {
+            io_timeout_ms = parseNumber<int>(key, value);
+        } else if (key == "compression") {
+            if (value != "gzip" && value != "off") {
+                throw std::invalid_argument("compression must be gzip or off");
+            }
+            compression = value == "gzip";
+        } else if (key == "compression-level") {
+            compression_level = parseNumber<int>(key, value);
+            if (compression_level < 1 || compression_level > 9) {
+                throw std::invalid_argument("compression-level must be between 1 and 9");
+            }
+        } else if (key == "compression-min-bytes") {
+            compression_min_bytes = parseSize(key, value);
+        } else if (key == "directory") {
+            directory = value;
+        } else if (key == "proxy") {
+            if (first_in_source) {
+                proxies.clear();
+            }
+            proxies.push_back(value);
+        } else if (key == "proxy-balance") {
+            proxy_balance = value;
+        } else if (key == "durable-writes") {
+            durable_writes = parseBool(key, value);
+        } else if (key == "group-commit-window-us") {
+            group_commit_window_us = parseNumber<long>(key, value);
+        } else if (key == "group-commit-sync") {
+            group_commit_sync = value;
+        } else if (key == "trace-sample") {
+            trace_sample = parseNumber<uint32_t>(key, value);
+        } else if (key == "cache-bytes") {
+            cache_bytes = parseSize(key, value);
+        } else if (key == "cache-route") {
+            if (first_in_source) {
+                cache_routes.clear();
+            }
+            cache_routes.push_back(value);
+        } else {
+            throw std::invalid_argument("Unknown option '" + key + "'");
+        }
+    }
+
+    static std::string trim(const std::string &str) {
+        const size_t first = str.find_first_not_of(" \t\r\n");
+        const size_t last = str.find_last_not_of(" \t\r\n");
+        return first == std::string::npos ? "" : str.substr(first, last - first + 1);
+    }
+
+    /**
+     * @brief Parses a non-negative number with an optional k/m/g (binary) suffix
+     * @throws std::invalid_argument on a sign, trailing garbage or a value that overflows size_t
+     */
+    static size_t parseSize(const std::string &key, const std::string &value) {
+        // stoull would accept leading whitespace and a sign, wrapping "-1" to SIZE_MAX
+        if (value.empty() || !std::isdigit(static_cast<unsigned char>(value[0]))) {
+            throw std::invalid_argument(key + " expects a number, got '" + value + "'");
+        }
+        size_t digits = 0;
+        unsigned long long number;
+        try {
+            number = std::stoull(value, &digits);
+        } catch (const std::exception &) {
+            throw std::invalid_argument(key + " expects a number, got '" + value + "'");
+        }
+        const std::string suffix = value.substr(digits);
+        if (suffix.empty()) {
+            return number;
+        }
+        int shift;
+        switch (suffix.size() == 1 ? std::tolower(static_cast<unsigned char>(suffix[0])) : 0) {
+            case 'k': shift = 10; break;
+            case 'm': shift = 20; break;
+            case 'g': shift = 30; break;
+            default: throw std::invalid_argument(key + " has an unknown size suffix '" + suffix + "'");
+        }
+        if (number > (std::numeric_limits<size_t>::max() >> shift)) {
+            throw std::invalid_argument(key + " is too large: '" + value + "'");
+        }
+        return static_cast<size_t>(number) << shift;
+    }
+
+    /**
+     * @brief Parses a number like parseSize() and checks that it fits the option's type
+     */
+    template <typename T>
+    static T parseNumber(const std::string &key, const std::string &value) {
+        const size_t number = parseSize(key, value);
+        if (number > static_cast<size_t>(std::numeric_limits<T>::max())) {
+            throw std::invalid_argument(key + " must be at most " + std::to_string(std::numeric_limits<T>::max()));
+        }
+        return static_cast<T>(number);
+    }
+
+    static bool parseBool(const std::string &key, const std::string &value) {
+        if (value == "true" || value == "on" || value == "1") {
+            return true;
+        }
+        if (value == "false" || value == "off" || value == "0") {
+            return false;
+        }
+        throw std::invalid_argument(key + " expects true or false, got '" + value + "'");
+    }
+
+    /**
+     * @brief Parses "host:port", or a bare port meaning all interfaces
+     */
+    static ListenAddress parseListenAddress(const std::string &value) {
+        const size_t colon = value.find_last_of(':');
+        const std::string host = colon == std::string::npos ? "0.0.0.0" : value.substr(0, colon);
+        const size_t port = parseSize("listen", colon == std::string::npos ? value : value.substr(colon + 1));
+        if (port == 0 || port > 65535) {
+            throw std::invalid_argument("listen has an invalid port in '" + value + "'");
+        }
+        return {host, static_cast<int>(port)};
+    }
+
+    static size_t readProcNumber(const char *path, size_t fallback) {
+        std::ifstream file(path);
+        size_t value = 0;
+        return file >> value && value > 0 ? value : fallback;
+    }
+
+    /**
+     * @brief Memory available to the process: MemAvailable, falling back to free pages
+     */
+    static size_t availableMemory() {
+        static constexpr std::string_view kMemAvailable = "MemAvailable:";
+
+        std::ifstream meminfo("/proc/meminfo");
+        std::string line;
+        while (std::getline(meminfo, line)) {
+            if (line.starts_with(kMemAvailable)) {
+                return std::stoull(line.substr(kMemAvailable.size())) * 1024;
+            }
+        }
+        return static_cast<size_t>(sysconf(_SC_AVPHYS_PAGES)) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    }
+};
+
+#endif //SERVER_CONFIG_H
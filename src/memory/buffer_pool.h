@@ -0,0 +1,233 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+class BufferPool;
+
+/**
+ * @class PooledBuffer
+ * @brief Move-only handle to a buffer borrowed from the BufferPool
+ *
+ * The buffer goes back to the pool when the handle is destroyed or reset,
+ * on whichever thread that happens.
+ */
+class PooledBuffer {
+public:
+    PooledBuffer() = default;
+    PooledBuffer(char* data, size_t capacity) : data_(data), capacity_(capacity) {}
+    ~PooledBuffer() { reset(); }
+
+    PooledBuffer(PooledBuffer&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr))
+        , capacity_(std::exchange(other.capacity_, 0))
+    {}
+
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept {
+        if (this != &other) {
+            reset();
+            data_ = std::exchange(other.data_, nullptr);
+            capacity_ = std::exchange(other.capacity_, 0);
+        }
+        return *this;
+    }
+
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+    [[nodiscard]] char* data() const { return data_; }
+    [[nodiscard]] size_t capacity() const { return capacity_; }
+    [[nodiscard]] bool empty() const { return data_ == nullptr; }
+
+    inline void reset();
+
+private:
+    char* data_ = nullptr;
+    size_t capacity_ = 0;
+};
+
+/**
+ * @class BufferPool
+ * @brief Size-classed slab pool for socket I/O buffers
+ *
+ * Buffers come in three size classes (4 KiB, 16 KiB, 64 KiB). Each thread keeps
+ * a small cache per class so steady-state acquire/release touches no lock and
+ * no allocator; caches spill to and refill from a shared depot in batches.
+ * A buffer may be released on a different thread from the one that acquired it.
+ * Idle memory held by the pool (thread caches plus depot) is capped globally;
+ * releases beyond the cap go straight back to the allocator. Requests larger
+ * than the biggest class are served by the allocator and never pooled.
+ */
+class BufferPool {
+public:
+    static constexpr std::array<size_t, 3> kSizeClasses = {4096, 16384, 65536};
+    static constexpr size_t kMaxPooledSize = kSizeClasses.back();
+
+    static BufferPool& instance() {
+        static BufferPool pool;
+        return pool;
+    }
+
+    /**
+     * @brief Sets the maximum number of idle bytes the pool may retain
+     */
+    void setRetainedLimit(size_t bytes) {
+        retained_limit_.store(bytes, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] size_t retainedLimit() const {
+        return retained_limit_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Borrows a buffer of at least min_capacity bytes
+     */
+    PooledBuffer acquire(size_t min_capacity) {
+        const int size_class = sizeClassFor(min_capacity);
+        if (size_class < 0) {
+            allocations_.fetch_add(1, std::memory_order_relaxed);
+            return {new char[min_capacity], min_capacity};
+        }
+
+        std::vector<char*>& cache = localCache().free[size_class];
+        if (cache.empty()) {
+            refill(size_class, cache);
+        }
+        if (!cache.empty()) {
+            char* data = cache.back();
+            cache.pop_back();
+            retained_bytes_.fetch_sub(kSizeClasses[size_class], std::memory_order_relaxed);
+            reuses_.fetch_add(1, std::memory_order_relaxed);
+            return {data, kSizeClasses[size_class]};
+        }
+
+        allocations_.fetch_add(1, std::memory_order_relaxed);
+        return {new char[kSizeClasses[size_class]], kSizeClasses[size_class]};
+    }
+
+    /**
+     * @brief Takes a buffer back; called by PooledBuffer
+     */
+    void release(char* data, size_t capacity) {
+        const int size_class = exactSizeClass(capacity);
+        if (size_class < 0 || !reserveRetained(capacity)) {
+            frees_.fetch_add(1, std::memory_order_relaxed);
+            delete[] data;
+            return;
+        }
+
+        std::vector<char*>& cache = localCache().free[size_class];
+        cache.push_back(data);
+        if (cache.size() > kLocalCacheLimit) {
+            spill(size_class, cache);
+        }
+    }
+
+    /**
+     * @brief Renders pool counters as "name value" lines
+     */
+    [[nodiscard]] std::string statsText() const {
+        std::ostringstream out;
+        out << "buffer_pool_allocations " << allocations_.load(std::memory_order_relaxed) << '\n'
+            << "buffer_pool_reuses " << reuses_.load(std::memory_order_relaxed) << '\n'
+            << "buffer_pool_frees " << frees_.load(std::memory_order_relaxed) << '\n'
+            << "buffer_pool_retained_bytes " << retained_bytes_.load(std::memory_order_relaxed) << '\n'
+            << "buffer_pool_retained_limit " << retained_limit_.load(std::memory_order_relaxed) << '\n';
+        return out.str();
+    }
+
+private:
+    /** Buffers a thread caches per size class before spilling half to the depot */
+    static constexpr size_t kLocalCacheLimit = 16;
+
+    struct LocalCache {
+        std::array<std::vector<char*>, kSizeClasses.size()> free;
+
+        ~LocalCache() {
+            // Hand everything to the depot so other threads can use it after this one exits
+            for (size_t i = 0; i < free.size(); i++) {
+                BufferPool& pool = instance();
+                std::lock_guard<std::mutex> lock(pool.depot_mutex_);
+                pool.depot_[i].insert(pool.depot_[i].end(), free[i].begin(), free[i].end());
+            }
+        }
+    };
+
+    std::mutex depot_mutex_;
+    std::array<std::vector<char*>, kSizeClasses.size()> depot_;
+
+    std::atomic<size_t> retained_limit_{64 * 1024 * 1024};
+    std::atomic<size_t> retained_bytes_{0};
+    std::atomic<uint64_t> allocations_{0};
+    std::atomic<uint64_t> reuses_{0};
+    std::atomic<uint64_t> frees_{0};
+
+    BufferPool() = default;
+
+    static LocalCache& localCache() {
+        thread_local LocalCache cache;
+        return cache;
+    }
+
+    static int sizeClassFor(size_t size) {
+        for (size_t i = 0; i < kSizeClasses.size(); i++) {
+            if (size <= kSizeClasses[i]) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    static int exactSizeClass(size_t capacity) {
+        for (size_t i = 0; i < kSizeClasses.size(); i++) {
+            if (capacity == kSizeClasses[i]) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    bool reserveRetained(size_t bytes) {
+        size_t current = retained_bytes_.load(std::memory_order_relaxed);
+        do {
+            if (current + bytes > retained_limit_.load(std::memory_order_relaxed)) {
+                return false;
+            }
+        } while (!retained_bytes_.compare_exchange_weak(current, current + bytes, std::memory_order_relaxed));
+        return true;
+    }
+
+    void refill(int size_class, std::vector<char*>& cache) {
+        std::lock_guard<std::mutex> lock(depot_mutex_);
+        std::vector<char*>& depot = depot_[size_class];
+        const size_t take = std::min(depot.size(), kLocalCacheLimit / 2);
+        cache.insert(cache.end(), depot.end() - static_cast<std::ptrdiff_t>(take), depot.end());
+        depot.resize(depot.size() - take);
+    }
+
+    void spill(int size_class, std::vector<char*>& cache) {
+        const size_t keep = kLocalCacheLimit / 2;
+        std::lock_guard<std::mutex> lock(depot_mutex_);
+        std::vector<char*>& depot = depot_[size_class];
+        depot.insert(depot.end(), cache.begin() + static_cast<std::ptrdiff_t>(keep), cache.end());
+        cache.resize(keep);
+    }
+};
+
+inline void PooledBuffer::reset() {
+    if (data_ != nullptr) {
+        BufferPool::instance().release(data_, capacity_);
+        data_ = nullptr;
+        capacity_ = 0;
+    }
+}
+
+#endif //BUFFER_POOL_H
@@ -0,0 +1,115 @@
+#ifndef IO_BUFFER_H
+#define IO_BUFFER_H
+
+#include <cstring>
+#include <string_view>
+
+#include "buffer_pool.h"
+
+/**
+ * @class IoBuffer
+ * @brief Growable byte queue backed by pooled buffers
+ *
+ * Bytes are appended at the write end and consumed from the read end. The
+ * backing buffer is borrowed lazily, grows by moving to the next size class,
+ * and can be handed back to the pool whenever the queue is empty, so an idle
+ * connection holds no buffer at all.
+ */
+class IoBuffer {
+public:
+    IoBuffer() = default;
+
+    /**
+     * @brief Returns space for at least min_free more bytes, growing if needed
+     *
+     * @param min_free Number of bytes the caller wants to write
+     * @return char* Start of the writable region; its size is writableSize()
+     */
+    char* prepare(size_t min_free) {
+        if (buffer_.capacity() - write_pos_ < min_free) {
+            const size_t used = size();
+            if (buffer_.capacity() - used >= min_free && read_pos_ > 0) {
+                // Enough room once the unread bytes are moved to the front
+                std::memmove(buffer_.data(), buffer_.data() + read_pos_, used);
+            } else {
+                PooledBuffer grown = BufferPool::instance().acquire(nextCapacity(used + min_free));
+                if (used > 0) {
+                    std::memcpy(grown.data(), buffer_.data() + read_pos_, used);
+                }
+                buffer_ = std::move(grown);
+            }
+            read_pos_ = 0;
+            write_pos_ = used;
+        }
+        return buffer_.data() + write_pos_;
+    }
+
+    [[nodiscard]] size_t writableSize() const {
+        return buffer_.capacity() - write_pos_;
+    }
+
+    /**
+     * @brief Marks n bytes written into the region returned by prepare() as readable
+     */
+    void commit(size_t n) {
+        write_pos_ += n;
+    }
+
+    void append(std::string_view data) {
+        std::memcpy(prepare(data.size()), data.data(), data.size());
+        commit(data.size());
+    }
+
+    [[nodiscard]] std::string_view readable() const {
+        return {buffer_.data() + read_pos_, size()};
+    }
+
+    [[nodiscard]] size_t size() const {
+        return write_pos_ - read_pos_;
+    }
+
+    [[nodiscard]] bool empty() const {
+        return size() == 0;
+    }
+
+    /**
+     * @brief Drops n bytes from the read end
+     */
+    void consume(size_t n) {
+        read_pos_ += n;
+        if (read_pos_ == write_pos_) {
+            read_pos_ = 0;
+            write_pos_ = 0;
+        }
+    }
+
+    /**
+     * @brief Hands the backing buffer back to the pool if no bytes are pending
+     */
+    void releaseIfEmpty() {
+        if (empty()) {
+            buffer_.reset();
+            read_pos_ = 0;
+            write_pos_ = 0;
+        }
+    }
+
+private:
+    PooledBuffer buffer_;
+    size_t read_pos_ = 0;
+    size_t write_pos_ = 0;
+
+    static size_t nextCapacity(size_t required) {
+        if (required > BufferPool::kMaxPooledSize) {
+            // Beyond the largest class: double to keep repeated growth amortised
+            size_t capacity = BufferPool::kMaxPooledSize;
+            while (capacity < required) {
+                capacity *= 2;
+            }
+            return capacity;
+        }
+        return required;
+    }
+};
+
+#endif //IO_BUFFER_H
@@ -0,0 +1,242 @@
+#ifndef UPSTREAM_H
+#define UPSTREAM_H
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+/**
+ * @class Upstream
+ * @brief A single backend (host:port) together with its idle keep-alive connections
+ *
+ * The address is resolved once at construction. Idle connections are kept on a
+ * small LIFO stack so the most recently used (and therefore most likely still
+ * open) socket is reused first.
+ */
+class Upstream {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Resolves the upstream address
+     *
+     * @param host Host name or IP address
+     * @param port TCP port
+     * @param max_idle_connections Maximum number of idle connections kept open
+     * @throws std::runtime_error if the host cannot be resolved
+     */
+    Upstream(std::string host, int port, size_t max_idle_connections = 32)
+        : host_(std::move(host))
+        , port_(port)
+        , max_idle_connections_(max_idle_connections)
+    {
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        addrinfo* result = nullptr;
+        const std::string service = std::to_string(port_);
+        if (getaddrinfo(host_.c_str(), service.c_str(), &hints, &result) != 0 || result == nullptr) {
+            throw std::runtime_error("Failed to resolve upstream " + authority());
+        }
+        std::memcpy(&address_, result->ai_addr, result->ai_addrlen);
+        address_length_ = result->ai_addrlen;
+        freeaddrinfo(result);
+    }
+
+    ~Upstream() {
+        for (const int fd : idle_connections_) {
+            close(fd);
+        }
+    }
+
+    Upstream(const Upstream&) = delete;
+    Upstream& operator=(const Upstream&) = delete;
+
+    /**
+     * @brief Parses a "host:port" specification
+     *
+     * @param spec Upstream specification, e.g. "127.0.0.1:8080"
+     * @return std::pair<std::string, int> Host and port
+     * @throws std::invalid_argument if the specification is malformed
+     */
+    static std::pair<std::string, int> parseSpec(const std::string& spec) {
+        const size_t colon = spec.find_last_of(':');
+        if (colon == std::string::npos || colon == 0 || colon + 1 == spec.size()) {
+            throw std::invalid_argument("Upstream must be host:port, got '" + spec + "'");
+        }
+        const int port = std::stoi(spec.substr(colon + 1));
+        if (port <= 0 || port > 65535) {
+            throw std::invalid_argument("Invalid upstream port in '" + spec + "'");
+        }
+        return {spec.substr(0, colon), port};
+    }
+
+    [[nodiscard]] std::string authority() const {
+        return host_ + ":" + std::to_string(port_);
+    }
+
+    /**
+     * @brief Takes an idle connection from the pool or opens a new one
+     *
+     * @param reused Set to true when the returned socket came from the pool
+     * @return int Connected socket, or -1 if the connection could not be established
+     */
+    int acquireConnection(bool& reused) {
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex_);
+            while (!idle_connections_.empty()) {
+                const int fd = idle_connections_.back();
+                idle_connections_.pop_back();
+                if (isIdleConnectionUsable(fd)) {
+                    reused = true;
+                    return fd;
+                }
+                close(fd);
+            }
+        }
+        reused = false;
+        return openConnection();
+    }
+
+    /**
+     * @brief Returns a connection to the idle pool, closing it if the pool is full
+     *
+     * @param fd Connected socket whose last response has been fully read
+     */
+    void releaseConnection(const int fd) {
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex_);
+            if (idle_connections_.size() < max_idle_connections_) {
+                idle_connections_.push_back(fd);
+                return;
+            }
+        }
+        close(fd);
+    }
+
+    /**
+     * @brief Passive health check: whether this upstream may receive traffic now
+     */
+    [[nodiscard]] bool isAvailable(const Clock::time_point now) const {
+        return downUntil() <= now;
+    }
+
+    /**
+     * @brief When the passive health check lets traffic through again (in the past if it already does)
+     */
+    [[nodiscard]] Clock::time_point downUntil() const {
+        return Clock::time_point(Clock::duration(down_until_.load(std::memory_order_relaxed)));
+    }
+
+    /**
+     * @brief Records a failed exchange; marks the upstream down after max_fails in a row
+     */
+    void recordFailure(const unsigned max_fails, const Clock::duration fail_timeout) {
+        if (consecutive_failures_.fetch_add(1, std::memory_order_relaxed) + 1 >= max_fails) {
+            down_until_.store((Clock::now() + fail_timeout).time_since_epoch().count(), std::memory_order_relaxed);
+            std::cerr << "Upstream " << authority() << " marked down" << std::endl;
+        }
+    }
+
+    void recordSuccess() {
+        consecutive_failures_.store(0, std::memory_order_relaxed);
+    }
+
+    /** Number of requests currently in flight to this upstream (least-connections key) */
+    std::atomic<unsigned> active_requests{0};
+
+private:
+    std::string host_;
+    int port_;
+    size_t max_idle_connections_;
+    sockaddr_storage address_ = {};
+    socklen_t address_length_ = 0;
+
+    std::mutex idle_mutex_;
+    std::vector<int> idle_connections_;
+
+    std::atomic<unsigned> consecutive_failures_{0};
+    std::atomic<Clock::rep> down_until_{0};
+
+    static constexpr int kConnectTimeoutMs = 5000;
+    static constexpr int kIoTimeoutSeconds = 30;
+
+    int openConnection() const {
+        const int fd = socket(address_.ss_family, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        if (!connectWithTimeout(fd)) {
+            close(fd);
+            return -1;
+        }
+
+        // Small request/response exchanges; don't let Nagle hold back the request
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        timeval timeout = {};
+        timeout.tv_sec = kIoTimeoutSeconds;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        return fd;
+    }
+
+    /**
+     * @brief Connects without blocking for longer than kConnectTimeoutMs
+     *
+     * A blocking connect() to an unreachable host would hold the worker for the
+     * kernel's SYN retry period (about two minutes). The socket is left blocking.
+     */
+    bool connectWithTimeout(const int fd) const {
+        const int flags = fcntl(fd, F_GETFL, 0);
+        if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+            return false;
+        }
+
+        if (connect(fd, reinterpret_cast<const sockaddr*>(&address_), address_length_) != 0) {
+            if (errno != EINPROGRESS) {
+                return false;
+            }
+            pollfd descriptor = {fd, POLLOUT, 0};
+            int ready;
+            while ((ready = poll(&descriptor, 1, kConnectTimeoutMs)) < 0 && errno == EINTR) {}
+            if (ready <= 0) {
+                std::cerr << "Connecting to upstream " << authority() << " timed out" << std::endl;
+                return false;
+            }
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+                return false;
+            }
+        }
+        return fcntl(fd, F_SETFL, flags) == 0;
+    }
+
+    /**
+     * @brief An idle keep-alive socket is usable if it has neither been closed
+     *        by the peer nor received unsolicited bytes
+     */
+    static bool isIdleConnectionUsable(const int fd) {
+        char probe;
+        const ssize_t n = recv(fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+        return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+};
+
+#endif //UPSTREAM_H
@@ -0,0 +1,137 @@
+#ifndef UPSTREAM_GROUP_H
+#define UPSTREAM_GROUP_H
+
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "upstream.h"
+
+/**
+ * @brief Strategy used to spread requests across the upstreams of a group
+ */
+enum class BalancingStrategy {
+    RoundRobin,
+    LeastConnections
+};
+
+/**
+ * @class UpstreamGroup
+ * @brief A set of interchangeable upstreams with load balancing and passive health checks
+ *
+ * An upstream that fails max_fails exchanges in a row is skipped for fail_timeout,
+ * after which it is tried again. If every upstream is down, select() still returns
+ * the one due back soonest: refusing outright would turn a brief outage of the
+ * whole group into errors for fail_timeout, while a request that gets through
+ * ends the outage early.
+ */
+class UpstreamGroup {
+public:
+    UpstreamGroup(
+        BalancingStrategy strategy,
+        unsigned max_fails = 3,
+        std::chrono::milliseconds fail_timeout = std::chrono::seconds(10)
+    )
+        : strategy_(strategy)
+        , max_fails_(max_fails)
+        , fail_timeout_(fail_timeout)
+    {}
+
+    /**
+     * @brief Parses a balancing strategy name ("round-robin" or "least-connections")
+     * @throws std::invalid_argument for unknown names
+     */
+    static BalancingStrategy parseStrategy(const std::string& name) {
+        if (name == "round-robin") {
+            return BalancingStrategy::RoundRobin;
+        }
+        if (name == "least-connections") {
+            return BalancingStrategy::LeastConnections;
+        }
+        throw std::invalid_argument("Unknown balancing strategy '" + name + "'");
+    }
+
+    void addUpstream(const std::string& host, int port) {
+        upstreams_.push_back(std::make_unique<Upstream>(host, port));
+    }
+
+    [[nodiscard]] size_t size() const {
+        return upstreams_.size();
+    }
+
+    /**
+     * @brief Picks the upstream for the next request
+     *
+     * @param exclude Upstream to avoid if any other is available (used on retry)
+     * @return Upstream* Selected upstream, nullptr only if the group is empty
+     */
+    Upstream* select(const Upstream* exclude = nullptr) {
+        const auto now = Upstream::Clock::now();
+        const size_t count = upstreams_.size();
+        const size_t start = next_.fetch_add(1, std::memory_order_relaxed);
+
+        Upstream* best = nullptr;
+        unsigned best_active = std::numeric_limits<unsigned>::max();
+
+        for (size_t i = 0; i < count; i++) {
+            Upstream* candidate = upstreams_[(start + i) % count].get();
+            if (candidate == exclude || !candidate->isAvailable(now)) {
+                continue;
+            }
+            if (strategy_ == BalancingStrategy::RoundRobin) {
+                return candidate;
+            }
+            const unsigned active = candidate->active_requests.load(std::memory_order_relaxed);
+            if (active < best_active) {
+                best = candidate;
+                best_active = active;
+            }
+        }
+
+        if (best == nullptr && exclude != nullptr && exclude->isAvailable(now)) {
+            return const_cast<Upstream*>(exclude);
+        }
+        if (best == nullptr) {
+            return soonestAvailable(exclude);
+        }
+        return best;
+    }
+
+    void recordFailure(Upstream& upstream) const {
+        upstream.recordFailure(max_fails_, fail_timeout_);
+    }
+
+    static void recordSuccess(Upstream& upstream) {
+        upstream.recordSuccess();
+    }
+
+private:
+    BalancingStrategy strategy_;
+    unsigned max_fails_;
+    std::chrono::milliseconds fail_timeout_;
+    std::vector<std::unique_ptr<Upstream>> upstreams_;
+    std::atomic<size_t> next_{0};
+
+    /**
+     * @brief Fallback when every upstream is down: the one whose fail_timeout ends first,
+     *        preferring any other over exclude
+     */
+    Upstream* soonestAvailable(const Upstream* exclude) const {
+        Upstream* soonest = nullptr;
+        for (const auto& candidate : upstreams_) {
+            if (candidate.get() == exclude) {
+                continue;
+            }
+            if (soonest == nullptr || candidate->downUntil() < soonest->downUntil()) {
+                soonest = candidate.get();
+            }
+        }
+        return soonest != nullptr ? soonest : const_cast<Upstream*>(exclude);
+    }
+};
+
+#endif //UPSTREAM_GROUP_H
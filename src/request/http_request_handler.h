@@ -2,13 +2,21 @@
 #define HTTP_REQUEST_HANDLER_H
 
 #include <iostream>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
 #include <unistd.h>
+#include <poll.h>
 #include <sys/socket.h>
-#include <array>
 #include <string>
-#include <stdexcept>
+#include <string_view>
 
 #include "http_request.h"
+#include "../config/server_config.h"
+#include "../memory/io_buffer.h"
+#include "../trace/tracer.h"
 
 /**
  * @class HttpRequestHandler
@@ -19,101 +27,267 @@ public:
   /**
    * @brief Constructs a new HTTP request handler
    * @param client_fd Client socket file descriptor
-   * @param server_fd Server socket file descriptor
+   * @param config Request size limits and the keep-alive idle timeout
    */
-  HttpRequestHandler(const int& client_fd, const int& server_fd)
-    : client_fd_(client_fd), server_fd_(server_fd) {}
+  HttpRequestHandler(const int& client_fd, const ServerConfig& config)
+    : client_fd_(client_fd)
+    , max_header_bytes_(config.max_header_bytes)
+    , max_body_bytes_(config.max_body_bytes)
+    , idle_timeout_ms_(config.idle_timeout_ms) {}
 
   /**
    * @brief Parses an HTTP request from the client socket
-   * @return HttpRequest The parsed HTTP request object
+   *
+   * Bytes received past the end of the request stay buffered for the next call.
+   * While no bytes are pending the receive buffer is returned to the pool, so an
+   * idle keep-alive connection holds no buffer while it waits.
+   *
+   * @return HttpRequest The parsed HTTP request object, or an empty request if
+   *         the client closed the connection, sent an oversized request, stayed
+   *         idle past the timeout or the receive failed; rejectionStatus() tells
+   *         an oversized or malformed request apart
    */
-  [[nodiscard]] HttpRequest parseRequest() const {
-    static constexpr size_t kMaxRequestSize = 1024;
-    static constexpr char kPathDelimiter = '/';
-    static constexpr char kWhitespaceDelimiter = ' ';
-    static const std::string kCarriageDelimiter = "\r\n";
-    
-    std::array<char, kMaxRequestSize> buffer{};
-    const long bytes_received = recv(client_fd_, buffer.data(), buffer.size(), 0);
-
-    if (bytes_received < 0) {
-      close(client_fd_);
-      close(server_fd_);
-      throw std::runtime_error("Failed to receive data from client");
-    }
+  [[nodiscard]] HttpRequest parseRequest() {
+    static constexpr size_t kRecvChunkSize = 4096;
 
-    HttpRequest request;
-    if (bytes_received == 0) {
-      return request; // Empty request
+    size_t header_size = 0;
+    size_t body_size = 0;
+    int rejection = 0;
+    while (!findCompleteRequest(header_size, body_size, rejection)) {
+      if (rejection != 0) {
+        std::cerr << "Rejecting request from fd " << client_fd_ << " with status " << rejection << std::endl;
+        rejection_status_ = rejection;
+        return {};
+      }
+
+      if (buffer_.empty()) {
+        buffer_.releaseIfEmpty();
+        if (!waitReadable()) {
+          return {};
+        }
+      }
+
+      long bytes_received;
+      {
+        TraceSpan span(TracePhase::Recv);
+        char* destination = buffer_.prepare(kRecvChunkSize);
+        bytes_received = recv(client_fd_, destination, buffer_.writableSize(), 0);
+      }
+
+      if (bytes_received < 0) {
+        std::cerr << "Failed to receive data from client fd " << client_fd_ << ": " << strerror(errno) << std::endl;
+        return {};
+      }
+      if (bytes_received == 0) {
+        return {}; // Empty request
+      }
+      buffer_.commit(bytes_received);
     }
 
-    // Convert received bytes to string and ensure proper size
-    std::string client_request(buffer.data(), bytes_received);
-    
-    // Parse HTTP method and path
-    const size_t path_start_pos = client_request.find_first_of(kPathDelimiter);
-    const size_t path_end_pos = client_request.find_first_of(kWhitespaceDelimiter, path_start_pos);
-    
-    request.method = client_request.substr(0, path_start_pos - 1);
-    request.path = client_request.substr(path_start_pos + 1, path_end_pos - path_start_pos - 1);
-    
-    // Parse headers and body
-    parseHeaders(request.headers, client_request);
-    request.body = client_request.substr(client_request.find_last_of(kCarriageDelimiter) + 1);
+    TraceSpan span(TracePhase::Parse);
+    const std::string_view data = buffer_.readable();
+    HttpRequest request;
+    parseRequestLine(request, data.substr(0, data.find(kCarriageDelimiter)));
+    parseHeaders(request.headers, data.substr(0, header_size));
+    request.body.assign(data.substr(header_size, body_size));
+    buffer_.consume(header_size + body_size);
+    buffer_.releaseIfEmpty();
 
     return request;
   }
 
+  /**
+   * @brief Status code to answer the request the last parseRequest() rejected
+   * @return int 431 if its headers or 413 if its body exceeded the limits, 400 if
+   *         its Content-Length was malformed or conflicting, 0 if nothing was rejected
+   */
+  [[nodiscard]] int rejectionStatus() const {
+    return rejection_status_;
+  }
+
+  /**
+   * @brief Whether a complete pipelined request is already buffered, so the
+   *        next parseRequest() returns without touching the socket
+   */
+  [[nodiscard]] bool hasBufferedRequest() const {
+    size_t header_size = 0;
+    size_t body_size = 0;
+    int rejection = 0;
+    return findCompleteRequest(header_size, body_size, rejection);
+  }
+
 private:
   const int client_fd_;
-  const int server_fd_;
+  const size_t max_header_bytes_;
+  const size_t max_body_bytes_;
+  const int idle_timeout_ms_;
+  IoBuffer buffer_;
+  int rejection_status_ = 0;
+
+  static constexpr int kBadRequest = 400;
+  static constexpr int kContentTooLarge = 413;
+  static constexpr int kHeaderFieldsTooLarge = 431;
+
+  static constexpr std::string_view kCarriageDelimiter = "\r\n";
+  static constexpr std::string_view kHeaderTerminator = "\r\n\r\n";
+
+  /**
+   * @brief Checks whether the buffer holds a complete request
+   * @param header_size Set to the size of the request line and headers including
+   *        the blank line
+   * @param body_size Set to the Content-Length of the request
+   * @param rejection Set to the status to answer with if the buffered request can
+   *        never become valid (400, 413 or 431)
+   * @return true if header_size + body_size bytes are buffered
+   */
+  bool findCompleteRequest(size_t& header_size, size_t& body_size, int& rejection) const {
+    const std::string_view data = buffer_.readable();
+    const size_t header_end = data.find(kHeaderTerminator);
+    if (header_end == std::string_view::npos) {
+      if (data.size() > max_header_bytes_) {
+        rejection = kHeaderFieldsTooLarge;
+      }
+      return false;
+    }
+
+    header_size = header_end + kHeaderTerminator.size();
+    if (header_size > max_header_bytes_) {
+      rejection = kHeaderFieldsTooLarge;
+      return false;
+    }
+    if (!contentLength(data.substr(0, header_size), body_size)) {
+      rejection = kBadRequest;
+      return false;
+    }
+    if (body_size > max_body_bytes_) {
+      rejection = kContentTooLarge;
+      return false;
+    }
+    return data.size() >= header_size + body_size;
+  }
 
   /**
-   * @brief Parses HTTP headers from the request string
+   * @brief Blocks until the client socket is readable, without holding a buffer
+   * @return false if the connection failed or stayed idle past the idle timeout
+   */
+  bool waitReadable() const {
+    pollfd descriptor = {client_fd_, POLLIN, 0};
+    int ready;
+    while ((ready = poll(&descriptor, 1, idle_timeout_ms_ > 0 ? idle_timeout_ms_ : -1)) < 0) {
+      if (errno != EINTR) {
+        return false;
+      }
+    }
+    return ready > 0;
+  }
+
+  /**
+   * @brief Parses "METHOD /path HTTP/1.1" into the method and the path without its leading slash
+   */
+  static void parseRequestLine(HttpRequest& request, const std::string_view line) {
+    static constexpr char kPathDelimiter = '/';
+    static constexpr char kWhitespaceDelimiter = ' ';
+
+    const size_t path_start_pos = line.find(kPathDelimiter);
+    const size_t method_end_pos = line.find(kWhitespaceDelimiter);
+    if (path_start_pos == std::string_view::npos || method_end_pos == std::string_view::npos) {
+      return;
+    }
+    const size_t path_end_pos = line.find(kWhitespaceDelimiter, path_start_pos);
+
+    request.method.assign(line.substr(0, method_end_pos));
+    request.path.assign(line.substr(path_start_pos + 1, path_end_pos - path_start_pos - 1));
+  }
+
+  /**
+   * @brief Parses HTTP headers from the request head
    * @param headers Map to store the parsed headers
-   * @param request_str Full HTTP request string
+   * @param head Request line and headers, terminated by an empty line
    */
-  static void parseHeaders(std::unordered_map<std::string, std::string>& headers, 
-                          const std::string& request_str) {
-    static const std::string kCarriageDelimiter = "\r\n";
-    static const std::string kKeyValueDelimiter = ": ";
-    
-    // Find headers section in the request
-    const size_t header_start = request_str.find_first_of(kCarriageDelimiter);
-    const size_t header_end = request_str.find_last_of(kCarriageDelimiter);
-    
-    if (header_start == std::string::npos || header_end == std::string::npos) {
+  static void parseHeaders(std::unordered_map<std::string, std::string>& headers,
+                          const std::string_view head) {
+    static constexpr std::string_view kKeyValueDelimiter = ": ";
+
+    // Skip the request line
+    size_t pos = head.find(kCarriageDelimiter);
+    if (pos == std::string_view::npos) {
       return;  // No headers found
     }
-    
-    // Extract headers text section
-    const std::string headers_text = request_str.substr(
-        header_start + 2, header_end - header_start - 3);
-    
-    // Parse individual headers
-    size_t pos = 0;
-    const size_t headers_end = headers_text.find_last_of(kCarriageDelimiter);
-    
-    while (pos < headers_end) {
-      const size_t key_end = headers_text.find_first_of(kKeyValueDelimiter, pos);
-      const size_t value_end = headers_text.find_first_of(kCarriageDelimiter, pos);
-      
-      if (key_end == std::string::npos || value_end == std::string::npos) {
-        break;  // Malformed header
+    pos += kCarriageDelimiter.length();
+
+    while (pos < head.size()) {
+      const size_t value_end = head.find(kCarriageDelimiter, pos);
+      if (value_end == std::string_view::npos || value_end == pos) {
+        break;  // End of headers
+      }
+
+      const size_t key_end = head.find(kKeyValueDelimiter, pos);
+      if (key_end != std::string_view::npos && key_end < value_end) {
+        const size_t value_start = key_end + kKeyValueDelimiter.length();
+        headers.emplace(head.substr(pos, key_end - pos), head.substr(value_start, value_end - value_start));
       }
-      
-      const std::string key = headers_text.substr(pos, key_end - pos);
-      const std::string value = headers_text.substr(
-          key_end + kKeyValueDelimiter.length(), 
-          value_end - key_end - kKeyValueDelimiter.length());
-          
-      headers[key] = value;
-      
+
       // Move to next header
       pos = value_end + kCarriageDelimiter.length();
     }
   }
+
+  /**
+   * @brief Reads the Content-Length from the request head, matching the name in any case
+   *
+   * Repeated fields and comma-separated lists are accepted only if every value
+   * agrees (RFC 9110 8.6); anything else could make the body be read as the next
+   * request.
+   *
+   * @param length Set to the body length, 0 if the field is absent
+   * @return false if a value is not a plain decimal number, overflows or conflicts
+   */
+  static bool contentLength(const std::string_view head, size_t& length) {
+    static constexpr std::string_view kContentLength = "content-length";
+    static constexpr std::string_view kWhitespace = " \t";
+
+    length = 0;
+    bool found = false;
+    size_t line_start = head.find(kCarriageDelimiter);
+    while (line_start != std::string_view::npos) {
+      line_start += kCarriageDelimiter.size();
+      const size_t line_end = head.find(kCarriageDelimiter, line_start);
+      const std::string_view line = head.substr(line_start, line_end - line_start);
+      line_start = line_end;
+
+      const size_t colon = line.find(':');
+      if (colon == std::string_view::npos || !equalsIgnoreCase(line.substr(0, colon), kContentLength)) {
+        continue;
+      }
+      std::string_view values = line.substr(colon + 1);
+      while (true) {
+        const size_t comma = values.find(',');
+        std::string_view value = values.substr(0, comma);
+        value.remove_prefix(std::min(value.find_first_not_of(kWhitespace), value.size()));
+        value.remove_suffix(value.size() - (value.find_last_not_of(kWhitespace) + 1));
+
+        size_t parsed = 0;
+        const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), parsed);
+        if (value.empty() || error != std::errc() || end != value.data() + value.size()
+            || (found && parsed != length)) {
+          return false;
+        }
+        length = parsed;
+        found = true;
+        if (comma == std::string_view::npos) {
+          break;
+        }
+        values.remove_prefix(comma + 1);
+      }
+    }
+    return true;
+  }
+
+  static bool equalsIgnoreCase(const std::string_view a, const std::string_view b) {
+    return std::ranges::equal(a, b, [](unsigned char x, unsigned char y) {
+      return std::tolower(x) == std::tolower(y);
+    });
+  }
 };
 
 #endif // HTTP_REQUEST_HANDLER_H
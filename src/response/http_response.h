@@ -2,14 +2,29 @@
 #define HTTP_RESPONSE_H
 
 #include <zlib.h>
-#include <sstream>
+#include <cctype>
+#include <charconv>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 #include <algorithm>
 #include <stdexcept>
 
+#include "response_body.h"
+#include "../memory/io_buffer.h"
+#include "../trace/tracer.h"
+
+/**
+ * @brief Process-wide compression settings, applied to every response
+ */
+struct CompressionPolicy {
+    bool enabled = true;
+    int level = Z_BEST_COMPRESSION;
+    size_t min_bytes = 0; ///< Bodies smaller than this are sent uncompressed
+};
+
 /**
  * @class HttpResponse
  * @brief Represents an HTTP response with methods to build and serialize it
@@ -20,6 +35,13 @@
  */
 class HttpResponse {
 public:
+    /**
+     * @brief Replaces the compression policy; call once at startup before serving requests
+     */
+    static void setCompressionPolicy(const CompressionPolicy& policy) {
+        compression_policy_ = policy;
+    }
+
     /**
      * @brief Constructs a new HTTP response with all necessary components
      * 
@@ -42,23 +64,100 @@ public:
         , status_code_(status_code)
         , content_type_(std::move(content_type))
         , content_length_(content_length)
-        , body_(std::move(body))
+        , body_(ResponseBody::owned(std::move(body)))
         , headers_(std::move(headers)) 
     {}
 
     /**
-     * @brief Builds and returns the complete HTTP response as a string
+     * @brief Constructs a response whose body is held without copying
      * 
-     * @return std::string The formatted HTTP response
+     * @param message Response status message (e.g., "OK", "Not Found")
+     * @param status_code HTTP status code (e.g., 200, 404)
+     * @param content_type MIME type of the response body
+     * @param body Response body; its size becomes the Content-Length
+     * @param headers Additional HTTP headers
      */
-    [[nodiscard]] std::string sendResponse() {
-        std::ostringstream response_stream;
-        
-        appendStatusLine(response_stream);
-        appendHeaders(response_stream);
-        appendBody(response_stream);
-        
-        return response_stream.str();
+    HttpResponse(
+        std::string message,
+        int status_code,
+        std::string content_type,
+        ResponseBody body,
+        std::unordered_map<std::string, std::string> headers
+    )
+        : message_(std::move(message))
+        , status_code_(status_code)
+        , content_type_(std::move(content_type))
+        , content_length_(body.size())
+        , body_(std::move(body))
+        , headers_(std::move(headers))
+    {}
+
+    /**
+     * @brief Wraps an already serialized response (status line, headers and body)
+     * 
+     * @param bytes The complete response, e.g. from the response cache
+     * @return HttpResponse A response that transmits bytes verbatim
+     */
+    static HttpResponse preserialized(ResponseBody::SharedBytes bytes) {
+        HttpResponse response("", 0, "", ResponseBody::shared(std::move(bytes)), {});
+        response.preserialized_ = true;
+        return response;
+    }
+
+    /**
+     * @brief Content coding the response to a request with these headers would use
+     * 
+     * @param headers Request headers
+     * @return std::string Selected encoding or empty string for none
+     */
+    [[nodiscard]] static std::string negotiatedEncoding(
+        const std::unordered_map<std::string, std::string>& headers
+    ) {
+        return compression_policy_.enabled ? getSupportedEncodings(headers) : "";
+    }
+
+    /**
+     * @brief Adds a header to send after the generated ones
+     *
+     * A Content-Encoding header marks the body as already encoded, so it is not
+     * compressed again.
+     */
+    void addHeader(std::string name, std::string value) {
+        extra_headers_.emplace_back(std::move(name), std::move(value));
+    }
+
+    [[nodiscard]] int statusCode() const {
+        return status_code_;
+    }
+
+    /**
+     * @brief Serializes the complete HTTP response into an output buffer
+     * 
+     * @param out Buffer the formatted HTTP response is appended to
+     */
+    void writeTo(IoBuffer& out) {
+        writeHeadTo(out);
+        appendBody(out);
+    }
+
+    /**
+     * @brief Serializes the status line and headers, compressing the body first if negotiated
+     * 
+     * @param out Buffer the status line and headers are appended to
+     */
+    void writeHeadTo(IoBuffer& out) {
+        if (preserialized_) {
+            return; // The body already holds the head
+        }
+        appendStatusLine(out);
+        appendHeaders(out);
+    }
+
+    /**
+     * @brief The body to transmit after the head; final once writeHeadTo() has run
+     */
+    [[nodiscard]] const ResponseBody& body() const {
+        return body_;
     }
 
 private:
@@ -67,8 +166,13 @@ private:
     int status_code_;
     std::string content_type_;
     size_t content_length_;
-    mutable std::string body_; // Mutable to allow compression in const methods
+    ResponseBody body_;
     std::unordered_map<std::string, std::string> headers_;
+    std::vector<std::pair<std::string, std::string>> extra_headers_;
+
+    bool preserialized_ = false;
+
+    static inline CompressionPolicy compression_policy_;
     
     // HTTP format constants
     static constexpr const char* WHITESPACE_DELIMITER = " ";
@@ -83,17 +187,38 @@ private:
     static constexpr const char* CONNECTION = "Connection";
     
     // Supported compression encodings
-    const std::vector<std::string> supported_encodings_ = { "gzip" };
+    static inline const std::vector<std::string> supported_encodings_ = { "gzip" };
 
     /**
      * @brief Appends the HTTP status line to the response stream
      * 
      * @param stream The output stream to append to
      */
-    void appendStatusLine(std::ostringstream& stream) const {
-        stream << "HTTP/1.1" << WHITESPACE_DELIMITER 
-               << status_code_ << WHITESPACE_DELIMITER 
-               << message_ << CARRIAGE_DELIMITER;
+    void appendStatusLine(IoBuffer& stream) const {
+        stream.append("HTTP/1.1");
+        stream.append(WHITESPACE_DELIMITER);
+        appendNumber(stream, status_code_);
+        stream.append(WHITESPACE_DELIMITER);
+        stream.append(message_);
+        stream.append(CARRIAGE_DELIMITER);
+    }
+
+    /**
+     * @brief Appends a "Name: value" header line
+     */
+    static void appendHeader(IoBuffer& stream, std::string_view name, std::string_view value) {
+        stream.append(name);
+        stream.append(COLON_DELIMITER);
+        stream.append(WHITESPACE_DELIMITER);
+        stream.append(value);
+        stream.append(CARRIAGE_DELIMITER);
+    }
+
+    template <typename Number>
+    static void appendNumber(IoBuffer& stream, Number value) {
+        char digits[24];
+        const auto [end, error] = std::to_chars(digits, digits + sizeof(digits), value);
+        stream.append(std::string_view(digits, end - digits));
     }
     
     /**
@@ -101,39 +226,62 @@ private:
      * 
      * @param stream The output stream to append to
      */
-    void appendHeaders(std::ostringstream& stream) {
-        // Apply compression if supported by the client
-        std::string encoding = getSupportedEncodings(headers_);
+    void appendHeaders(IoBuffer& stream) {
+        // Apply compression if the policy allows it and the client supports it
+        const bool compressible = compression_policy_.enabled && body_.size() >= compression_policy_.min_bytes
+                                  && !hasExtraHeader(CONTENT_ENCODING);
+        std::string encoding = compressible ? getSupportedEncodings(headers_) : "";
         if (!encoding.empty()) {
-            stream << CONTENT_ENCODING << COLON_DELIMITER << WHITESPACE_DELIMITER 
-                   << encoding << CARRIAGE_DELIMITER;
-            body_ = compressString(body_);
+            appendHeader(stream, CONTENT_ENCODING, encoding);
+            TraceSpan span(TracePhase::Compress);
+            body_ = ResponseBody::owned(!body_.inMemory()
+                ? compressString(body_.materialize(), compression_policy_.level)
+                : compressString(body_.bytes(), compression_policy_.level));
             content_length_ = body_.size();
         }
         
         // Add standard headers
-        stream << CONTENT_TYPE << COLON_DELIMITER << WHITESPACE_DELIMITER 
-               << content_type_ << CARRIAGE_DELIMITER;
-        stream << CONTENT_LENGTH << COLON_DELIMITER << WHITESPACE_DELIMITER 
-               << content_length_ << CARRIAGE_DELIMITER;
+        appendHeader(stream, CONTENT_TYPE, content_type_);
+        stream.append(CONTENT_LENGTH);
+        stream.append(COLON_DELIMITER);
+        stream.append(WHITESPACE_DELIMITER);
+        appendNumber(stream, content_length_);
+        stream.append(CARRIAGE_DELIMITER);
+        for (const auto& [name, value] : extra_headers_) {
+            appendHeader(stream, name, value);
+        }
         
         // Add Connection: close header if requested
         if (headers_.contains(CONNECTION) && headers_.at(CONNECTION) == "close") {
-            stream << CONNECTION << COLON_DELIMITER << WHITESPACE_DELIMITER 
-                   << "close" << CARRIAGE_DELIMITER;
+            appendHeader(stream, CONNECTION, "close");
         }
         
         // Add blank line to separate headers from body
-        stream << CARRIAGE_DELIMITER;
+        stream.append(CARRIAGE_DELIMITER);
     }
     
+    /**
+     * @brief Whether an extra header with this name (compared case-insensitively) was added
+     */
+    [[nodiscard]] bool hasExtraHeader(std::string_view name) const {
+        return std::ranges::any_of(extra_headers_, [name](const auto& header) {
+            return std::ranges::equal(header.first, name, [](unsigned char a, unsigned char b) {
+                return std::tolower(a) == std::tolower(b);
+            });
+        });
+    }
+
     /**
      * @brief Appends the response body to the stream
      * 
      * @param stream The output stream to append to
      */
-    void appendBody(std::ostringstream& stream) const {
-        stream << body_;
+    void appendBody(IoBuffer& stream) const {
+        if (!body_.inMemory()) {
+            stream.append(body_.materialize());
+        } else {
+            stream.append(body_.bytes());
+        }
     }
 
     /**
@@ -181,9 +329,9 @@ private:
      * @param headers Request headers containing encoding preferences
      * @return std::string Selected encoding or empty string if none supported
      */
-    [[nodiscard]] std::string getSupportedEncodings(
+    [[nodiscard]] static std::string getSupportedEncodings(
         const std::unordered_map<std::string, std::string>& headers
-    ) const {
+    ) {
         auto it = headers.find(ACCEPT_ENCODING);
 
         if (it != headers.end()) {
@@ -209,7 +357,7 @@ private:
      * @throws std::runtime_error if compression fails
      */
     static std::string compressString(
-        const std::string& str, 
+        std::string_view str,
         int compressionLevel = Z_BEST_COMPRESSION
     ) {
         z_stream zs = {}; // z_stream is zlib's control structure
@@ -0,0 +1,226 @@
+#ifndef RESPONSE_BODY_H
+#define RESPONSE_BODY_H
+
+#include <cerrno>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+/**
+ * @class FileHandle
+ * @brief Owns an open file descriptor and closes it on destruction
+ */
+class FileHandle {
+public:
+    explicit FileHandle(int fd) : fd_(fd) {}
+    ~FileHandle() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    FileHandle(const FileHandle&) = delete;
+    FileHandle& operator=(const FileHandle&) = delete;
+
+    [[nodiscard]] int fd() const { return fd_; }
+
+private:
+    int fd_;
+};
+
+/**
+ * @brief A byte range of an open file, transmitted with sendfile()
+ */
+struct FileRegion {
+    std::shared_ptr<FileHandle> file;
+    off_t offset = 0;
+    size_t length = 0;
+};
+
+/**
+ * @class SocketHandle
+ * @brief Owns a connected socket a response body is still to be read from
+ *
+ * On destruction the socket goes to the release callback, together with whether
+ * the body was read to its end, i.e. whether the connection can carry another
+ * exchange or has to be closed.
+ */
+class SocketHandle {
+public:
+    using Release = std::function<void(int fd, bool drained)>;
+
+    SocketHandle(int fd, Release release) : fd_(fd), release_(std::move(release)) {}
+    ~SocketHandle() {
+        release_(fd_, drained_);
+    }
+
+    SocketHandle(const SocketHandle&) = delete;
+    SocketHandle& operator=(const SocketHandle&) = delete;
+
+    [[nodiscard]] int fd() const { return fd_; }
+    [[nodiscard]] bool drained() const { return drained_; }
+    void markDrained() { drained_ = true; }
+
+private:
+    int fd_;
+    Release release_;
+    bool drained_ = false;
+};
+
+/**
+ * @brief The rest of a body still unread on a socket, transmitted with splice()
+ */
+struct SocketRegion {
+    std::shared_ptr<SocketHandle> socket;
+    std::string buffered; ///< Body bytes already read along with the head; sent first
+    size_t length = 0;    ///< Bytes still to be read from the socket
+};
+
+/**
+ * @class ResponseBody
+ * @brief The payload of an HttpResponse, held without copying where possible
+ *
+ * A body is one of:
+ *  - owned bytes, for content generated by the action;
+ *  - a view into the request that produced the response. The connection loop
+ *    keeps that HttpRequest alive until the response has been sent, so views
+ *    into its path, parameters, headers or body stay valid;
+ *  - a shared immutable buffer, for content that outlives any single request;
+ *  - a region of an open file;
+ *  - the unread rest of a body on another socket, e.g. an upstream connection.
+ */
+class ResponseBody {
+public:
+    using SharedBytes = std::shared_ptr<const std::string>;
+
+    ResponseBody() = default;
+
+    static ResponseBody owned(std::string bytes) {
+        return ResponseBody(Storage(std::in_place_type<std::string>, std::move(bytes)));
+    }
+
+    static ResponseBody view(std::string_view bytes) {
+        return ResponseBody(Storage(std::in_place_type<std::string_view>, bytes));
+    }
+
+    static ResponseBody shared(SharedBytes bytes) {
+        return ResponseBody(Storage(std::in_place_type<SharedBytes>, std::move(bytes)));
+    }
+
+    static ResponseBody file(FileRegion region) {
+        return ResponseBody(Storage(std::in_place_type<FileRegion>, std::move(region)));
+    }
+
+    static ResponseBody socket(SocketRegion region) {
+        return ResponseBody(Storage(std::in_place_type<SocketRegion>, std::move(region)));
+    }
+
+    [[nodiscard]] size_t size() const {
+        if (const FileRegion* region = fileRegion()) {
+            return region->length;
+        }
+        if (const SocketRegion* region = socketRegion()) {
+            return region->buffered.size() + region->length;
+        }
+        return bytes().size();
+    }
+
+    [[nodiscard]] const FileRegion* fileRegion() const {
+        return std::get_if<FileRegion>(&storage_);
+    }
+
+    [[nodiscard]] const SocketRegion* socketRegion() const {
+        return std::get_if<SocketRegion>(&storage_);
+    }
+
+    /**
+     * @brief Whether bytes() holds the whole body
+     */
+    [[nodiscard]] bool inMemory() const {
+        return fileRegion() == nullptr && socketRegion() == nullptr;
+    }
+
+    /**
+     * @brief The body bytes of an in-memory body; empty for file and socket regions
+     */
+    [[nodiscard]] std::string_view bytes() const {
+        if (const auto* owned = std::get_if<std::string>(&storage_)) {
+            return *owned;
+        }
+        if (const auto* view = std::get_if<std::string_view>(&storage_)) {
+            return *view;
+        }
+        if (const auto* shared = std::get_if<SharedBytes>(&storage_)) {
+            return *shared ? std::string_view(**shared) : std::string_view();
+        }
+        return {};
+    }
+
+    /**
+     * @brief Copies the body into a string, reading file regions from disk and
+     *        socket regions from their socket
+     *
+     * A socket region can be read only once; it is then drained and can no longer
+     * be transmitted.
+     *
+     * @throws std::runtime_error if a region cannot be read completely
+     */
+    [[nodiscard]] std::string materialize() const {
+        if (const SocketRegion* region = socketRegion()) {
+            return readSocket(*region);
+        }
+        const FileRegion* region = fileRegion();
+        if (region == nullptr) {
+            return std::string(bytes());
+        }
+
+        std::string contents(region->length, '\0');
+        size_t done = 0;
+        while (done < region->length) {
+            const ssize_t n = pread(region->file->fd(), contents.data() + done,
+                                    region->length - done, region->offset + static_cast<off_t>(done));
+            if (n <= 0) {
+                throw std::runtime_error("Failed to read response body from file");
+            }
+            done += static_cast<size_t>(n);
+        }
+        return contents;
+    }
+
+private:
+    using Storage = std::variant<std::string, std::string_view, SharedBytes, FileRegion, SocketRegion>;
+
+    explicit ResponseBody(Storage storage) : storage_(std::move(storage)) {}
+
+    static std::string readSocket(const SocketRegion& region) {
+        if (region.socket->drained()) {
+            throw std::runtime_error("Response body was already read from its socket");
+        }
+        std::string contents = region.buffered;
+        size_t done = contents.size();
+        contents.resize(done + region.length);
+        while (done < contents.size()) {
+            const ssize_t n = recv(region.socket->fd(), contents.data() + done, contents.size() - done, 0);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                throw std::runtime_error("Failed to read response body from socket");
+            }
+            done += static_cast<size_t>(n);
+        }
+        region.socket->markDrained();
+        return contents;
+    }
+
+    Storage storage_;
+};
+
+#endif //RESPONSE_BODY_H
@@ -0,0 +1,253 @@
+#ifndef RESPONSE_WRITER_H
+#define RESPONSE_WRITER_H
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <exception>
+#include <iostream>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "http_response.h"
+#include "../memory/io_buffer.h"
+#include "../trace/tracer.h"
+
+/**
+ * @class ResponseWriter
+ * @brief Transmits batches of responses on a client socket without copying their bodies
+ *
+ * Responses to pipelined requests are added in order and go out together on
+ * flush(). Their heads are serialized back to back into one pooled buffer and
+ * in-memory bodies (owned, view or shared) are gathered between them, so a batch
+ * normally leaves in a single sendmsg(), which works like writev() but can pass
+ * MSG_NOSIGNAL. File regions are sent with sendfile() and socket regions are
+ * spliced through a pipe, each in its place in the stream; the socket is corked
+ * for such batches so the pieces before and after them still fill whole segments.
+ */
+class ResponseWriter {
+public:
+    explicit ResponseWriter(int client_fd) : client_fd_(client_fd) {}
+
+    ~ResponseWriter() {
+        closePipe();
+    }
+
+    ResponseWriter(const ResponseWriter&) = delete;
+    ResponseWriter& operator=(const ResponseWriter&) = delete;
+
+    /**
+     * @brief Serializes a response and queues it behind those already added
+     *
+     * The response is kept until flush(), so a body that views request data
+     * requires the request to stay alive (and in place) until then.
+     *
+     * @return bool false if the response could not be serialized (e.g. a file
+     *         shrank before it was read for compression); a 500 asking the client
+     *         to close is queued in its place and the connection should end
+     */
+    bool add(HttpResponse&& response) {
+        const size_t head_offset = head_.size();
+        try {
+            TraceSpan span(TracePhase::Serialize);
+            response.writeHeadTo(head_);
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to serialize response on fd " << client_fd_ << ": " << e.what() << std::endl;
+            // Whatever the failed head left in head_ lies outside every recorded range and is never sent
+            HttpResponse error("Internal Server Error", 500, "text/plain", 0, "", {{"Connection", "close"}});
+            const size_t error_offset = head_.size();
+            error.writeHeadTo(head_);
+            pending_.push_back({std::move(error), error_offset, head_.size() - error_offset});
+            return false;
+        }
+        pending_.push_back({std::move(response), head_offset, head_.size() - head_offset});
+        return true;
+    }
+
+    /**
+     * @brief Sends every queued response, in the order they were added
+     * @return bool false if the client connection failed
+     */
+    bool flush() {
+        TraceSpan span(TracePhase::Send);
+
+        // Segments point into head_ and the bodies, so build them only once both stop moving
+        const std::string_view heads = head_.readable();
+        std::vector<iovec> segments;
+        segments.reserve(pending_.size() * 2);
+        bool corked = false;
+        bool ok = true;
+        for (const PendingResponse& pending : pending_) {
+            appendSegment(segments, heads.substr(pending.head_offset, pending.head_length));
+            const ResponseBody& body = pending.response.body();
+            if (body.inMemory()) {
+                appendSegment(segments, body.bytes());
+                continue;
+            }
+            if (!corked) {
+                corked = setCork(true);
+            }
+            if (const FileRegion* region = body.fileRegion()) {
+                ok = sendSegments(segments, MSG_MORE) && sendFile(*region);
+            } else {
+                const SocketRegion& stream = *body.socketRegion();
+                appendSegment(segments, stream.buffered);
+                ok = sendSegments(segments, MSG_MORE) && spliceSocket(stream);
+            }
+            if (!ok) {
+                break;
+            }
+        }
+        ok = ok && sendSegments(segments, 0);
+        if (corked) {
+            setCork(false);
+        }
+
+        // Hand the head buffer back to the pool before waiting for the next requests
+        pending_.clear();
+        head_.consume(head_.size());
+        head_.releaseIfEmpty();
+        return ok;
+    }
+
+private:
+    struct PendingResponse {
+        HttpResponse response;
+        size_t head_offset;
+        size_t head_length;
+    };
+
+    // Upper bound on one splice() into the pipe; the default pipe capacity
+    static constexpr size_t kPipeChunkSize = 64 * 1024;
+
+    int client_fd_;
+    IoBuffer head_;
+    std::vector<PendingResponse> pending_;
+    // Created on the first socket region and kept for the connection's lifetime
+    int pipe_[2] = {-1, -1};
+
+    static void appendSegment(std::vector<iovec>& segments, std::string_view bytes) {
+        if (!bytes.empty()) {
+            segments.push_back({const_cast<char*>(bytes.data()), bytes.size()});
+        }
+    }
+
+    /**
+     * @brief Holds back partial segments until uncorked; false if the option could not be set
+     */
+    bool setCork(bool enabled) const {
+        const int value = enabled ? 1 : 0;
+        return setsockopt(client_fd_, IPPROTO_TCP, TCP_CORK, &value, sizeof(value)) == 0;
+    }
+
+    /**
+     * @brief Sends and clears the gathered segments
+     * @param flags Extra send flags for the final sendmsg(); earlier ones, needed
+     *        when there are more than IOV_MAX segments, always carry MSG_MORE
+     */
+    bool sendSegments(std::vector<iovec>& segments, int flags) const {
+        size_t first = 0;
+        while (first < segments.size()) {
+            const size_t count = std::min<size_t>(segments.size() - first, IOV_MAX);
+            const bool last = first + count == segments.size();
+            msghdr message = {};
+            message.msg_iov = segments.data() + first;
+            message.msg_iovlen = count;
+
+            const ssize_t sent = sendmsg(client_fd_, &message, MSG_NOSIGNAL | (last ? flags : MSG_MORE));
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            if (sent <= 0) {
+                return false;
+            }
+
+            // Skip the segments that went out completely and trim a partially sent one
+            size_t remaining = static_cast<size_t>(sent);
+            while (remaining > 0 && remaining >= segments[first].iov_len) {
+                remaining -= segments[first].iov_len;
+                first++;
+            }
+            if (remaining > 0) {
+                segments[first].iov_base = static_cast<char*>(segments[first].iov_base) + remaining;
+                segments[first].iov_len -= remaining;
+            }
+        }
+        segments.clear();
+        return true;
+    }
+
+    bool sendFile(const FileRegion& region) const {
+        off_t offset = region.offset;
+        size_t remaining = region.length;
+        while (remaining > 0) {
+            const ssize_t sent = sendfile(client_fd_, region.file->fd(), &offset, remaining);
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            if (sent <= 0) {
+                return false;
+            }
+            remaining -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Moves the rest of a socket region to the client through the pipe,
+     *        without copying it to user space
+     *
+     * The region's socket is marked drained only once every byte went out.
+     */
+    bool spliceSocket(const SocketRegion& region) {
+        if (pipe_[0] < 0 && pipe2(pipe_, O_CLOEXEC) != 0) {
+            return false;
+        }
+        size_t remaining = region.length;
+        while (remaining > 0) {
+            const ssize_t in_pipe = splice(region.socket->fd(), nullptr, pipe_[1], nullptr,
+                                           std::min(remaining, kPipeChunkSize), SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (in_pipe < 0 && errno == EINTR) {
+                continue;
+            }
+            if (in_pipe <= 0) {
+                closePipe();
+                return false;
+            }
+            size_t pending = static_cast<size_t>(in_pipe);
+            while (pending > 0) {
+                const ssize_t sent = splice(pipe_[0], nullptr, client_fd_, nullptr, pending,
+                                            SPLICE_F_MOVE | SPLICE_F_MORE);
+                if (sent < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (sent <= 0) {
+                    closePipe(); // It may still hold bytes that belong to this response
+                    return false;
+                }
+                pending -= static_cast<size_t>(sent);
+            }
+            remaining -= static_cast<size_t>(in_pipe);
+        }
+        region.socket->markDrained();
+        return true;
+    }
+
+    void closePipe() {
+        for (int& fd : pipe_) {
+            if (fd >= 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+    }
+};
+
+#endif //RESPONSE_WRITER_H
@@ -8,6 +8,11 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <regex>
+#include <csignal>
+#include <fstream>
+#include <thread>
+#include <deque>
+#include <poll.h>
 
 #include "request/http_request_handler.h"
 #include "url/abstract_url_action.h"
@@ -17,60 +22,217 @@
 #include "url/user_agent_url_action.h"
 #include "concurrent/thread_pool.h"
 #include "url/file_url_action.h"
+#include "url/proxy_url_action.h"
+#include "url/stats_url_action.h"
+#include "url/trace_url_action.h"
+#include "proxy/upstream_group.h"
+#include "storage/group_commit_writer.h"
+#include "trace/tracer.h"
+#include "memory/buffer_pool.h"
+#include "response/response_writer.h"
+#include "config/server_config.h"
+#include "cache/response_cache.h"
+
+/**
+ * @brief Registers a reverse proxy route from a "--proxy" specification
+ *
+ * @param url_handler Handler to register the route with
+ * @param spec "<prefix>=<host:port>[,<host:port>...]"
+ * @param strategy Balancing strategy for the route's upstream group
+ * @param max_body_bytes Largest upstream response body the route accepts
+ */
+static void registerProxy(URLHandler& url_handler, const std::string& spec, BalancingStrategy strategy,
+                          size_t max_body_bytes) {
+  const size_t eq = spec.find('=');
+  if (eq == std::string::npos) {
+    throw std::invalid_argument("--proxy expects <prefix>=<host:port>[,<host:port>...]");
+  }
+  const std::string prefix = spec.substr(0, eq);
+  auto upstreams = std::make_shared<UpstreamGroup>(strategy);
+
+  size_t start = eq + 1;
+  while (start <= spec.size()) {
+    size_t end = spec.find(',', start);
+    if (end == std::string::npos) {
+      end = spec.size();
+    }
+    const auto [host, port] = Upstream::parseSpec(spec.substr(start, end - start));
+    upstreams->addUpstream(host, port);
+    start = end + 1;
+  }
+
+  url_handler.registerUrl(prefix, std::make_shared<ProxyUrlAction>(prefix, upstreams, max_body_bytes));
+  std::cout << "Proxying /" << prefix << " to " << upstreams->size() << " upstream(s)\n";
+}
+
+/**
+ * @brief Enables the response cache for the routes listed in the configuration
+ *
+ * Each route is given as "<route>=<ttl-ms>"; a leading slash is optional and "/"
+ * names the root route.
+ */
+static void enableResponseCache(URLHandler& url_handler, StatsUrlAction& stats_action, const ServerConfig& config) {
+  std::unordered_map<std::string, std::chrono::milliseconds> ttls;
+  for (const std::string& spec : config.cache_routes) {
+    const size_t eq = spec.find('=');
+    if (eq == std::string::npos) {
+      throw std::invalid_argument("cache-route expects <route>=<ttl-ms>, got '" + spec + "'");
+    }
+    std::string route = spec.substr(0, eq);
+    if (route.starts_with('/')) {
+      route.erase(0, 1);
+    }
+    ttls[route] = std::chrono::milliseconds(std::stoll(spec.substr(eq + 1)));
+  }
+
+  auto cache = std::make_shared<ResponseCache>(config.cache_bytes);
+  url_handler.enableCache(cache, std::move(ttls));
+  stats_action.addSource([cache] { return cache->statsText(); });
+}
+
+/**
+ * @brief Response for a request the parser refused
+ * @param status 400 (malformed framing), 431 (headers too large) or 413 (body too large)
+ */
+static HttpResponse rejectionResponse(const int status) {
+  const std::string message = status == 400 ? "Bad Request"
+                            : status == 431 ? "Request Header Fields Too Large"
+                            : "Content Too Large";
+  return {message, status, "text/plain", 0, "", {{"Connection", "close"}}};
+}
 
 class Server {
 public:
-  Server(const int &client_fd, const int &server_fd, URLHandler& url_handler): client_fd(client_fd), server_fd(server_fd), url_handler(url_handler) {};
+  Server(const int &client_fd, URLHandler& url_handler, const ServerConfig& config): client_fd(client_fd), url_handler(url_handler), config(config) {};
   void sendResponse(const std::string& directory_name) const {
-    HttpRequestHandler request_handler(client_fd, server_fd);
-
-    while (true) {
-      // Parse incoming HTTP request
-      HttpRequest request = request_handler.parseRequest();
-      
-      // Check if connection should be closed
-      if (request.headers.empty()) {
-        break;
-      }
+    HttpRequestHandler request_handler(client_fd, config);
+    ResponseWriter writer(client_fd);
+    // Bodies may refer to their requests until flushed; a deque keeps them in place as it grows
+    std::deque<HttpRequest> batch;
 
-      // Process request and send response
-      std::string response = url_handler.sendResponseForUrl(request, directory_name);
-      size_t response_size = response.size();
-      send(client_fd, response.c_str(), response_size, 0);
+    bool keep_alive = true;
+    bool rejected = false;
+    while (keep_alive) {
+      // Answer every request the client has already pipelined before sending any of the responses
+      bool more_buffered;
+      do {
+        Tracer::beginRequest();
 
-      if (request.headers.contains("Connection") && request.headers.at("Connection") == "close") {
-        break;
+        // Parse incoming HTTP request
+        HttpRequest& request = batch.emplace_back(request_handler.parseRequest());
+
+        // Check if connection should be closed
+        if (request.headers.empty()) {
+          Tracer::abandonRequest();
+          batch.pop_back();
+          keep_alive = false;
+          if (const int status = request_handler.rejectionStatus()) {
+            // Tell the client why it is dropped, after the responses already batched
+            writer.add(rejectionResponse(status));
+            rejected = true;
+          }
+          break;
+        }
+
+        const bool serialized = writer.add(url_handler.handleRequest(request, directory_name));
+        keep_alive = serialized
+                     && !(request.headers.contains("Connection") && request.headers.at("Connection") == "close");
+        more_buffered = keep_alive && batch.size() < kMaxPipelineBatch && request_handler.hasBufferedRequest();
+        if (more_buffered) {
+          Tracer::endRequest();
+        }
+      } while (more_buffered);
+
+      // The flush is traced as part of the last request in the batch
+      if (!batch.empty() || rejected) {
+        keep_alive = writer.flush() && keep_alive;
+        Tracer::endRequest();
+        batch.clear();
       }
     }
-    
+
+    if (rejected) {
+      drainBeforeClose();
+    }
     close(client_fd);
   }
 private:
+  /**
+   * @brief Closes our side and discards what the client is still sending
+   *
+   * Closing a socket with unread input makes the kernel reset the connection,
+   * which can destroy the rejection response before the client reads it.
+   */
+  void drainBeforeClose() const {
+    shutdown(client_fd, SHUT_WR);
+    char discard[4096];
+    size_t drained = 0;
+    pollfd descriptor = {client_fd, POLLIN, 0};
+    while (drained < kMaxDrainBytes && poll(&descriptor, 1, kDrainTimeoutMs) > 0) {
+      const ssize_t n = recv(client_fd, discard, sizeof(discard), 0);
+      if (n <= 0) {
+        break;
+      }
+      drained += static_cast<size_t>(n);
+    }
+  }
+
+  // Bounds the responses held in memory for one flush
+  static constexpr size_t kMaxPipelineBatch = 64;
+
+  static constexpr int kDrainTimeoutMs = 1000;
+  static constexpr size_t kMaxDrainBytes = 1 << 20;
+
   const int client_fd;
-  const int server_fd;
   URLHandler& url_handler;
+  const ServerConfig& config;
 };
 
-int main(int argc, char **argv) {
-  // Flush after every std::cout / std::cerr
-  std::cout << std::unitbuf;
-  std::cerr << std::unitbuf;
-  std::string dir;
-  
-  // You can use print statements as follows for debugging, they'll be visible when running tests.
-  std::cout << "Logs from your program will appear here!\n";
+/**
+ * @brief Writes a Chrome trace file to the working directory on every SIGUSR1
+ *
+ * SIGUSR1 must already be blocked in every thread so that only this one receives it.
+ */
+static void startTraceDumpThread() {
+  std::thread([] {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    for (int dump = 1;; dump++) {
+      int signal;
+      if (sigwait(&signals, &signal) != 0) {
+        return;
+      }
+      const std::string path = "trace-" + std::to_string(getpid()) + "-" + std::to_string(dump) + ".json";
+      std::ofstream out(path);
+      out << Tracer::exportChromeTrace();
+      std::cout << "Trace written to " << path << std::endl;
+    }
+  }).detach();
+}
 
-  if (argc == 3 && strcmp(argv[1], "--directory") == 0)
-  {
-    dir = argv[2];
-  }
+/**
+ * @brief Creates a listening socket for one configured address
+ * @return int The listening socket, or -1 on failure
+ */
+static int openListener(const ListenAddress& address, int backlog) {
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
 
-  // Uncomment this block to pass the first stage
+  addrinfo* result = nullptr;
+  const std::string port = std::to_string(address.port);
+  if (getaddrinfo(address.host.c_str(), port.c_str(), &hints, &result) != 0 || result == nullptr) {
+    std::cerr << "Failed to resolve listen address " << address.host << "\n";
+    return -1;
+  }
 
-  int server_fd = socket(AF_INET, SOCK_STREAM, 0); //AF->ADDRESS FAMILY; By specifying 0, you allow the system to choose the default protocol for the given socket type, which is TCP for SOCK_STREAM
+  int server_fd = socket(result->ai_family, SOCK_STREAM, 0);
   if (server_fd < 0) {
    std::cerr << "Failed to create server socket\n";
-   return 1;
+   freeaddrinfo(result);
+   return -1;
   }
 
   // Since the tester restarts your program quite often, setting SO_REUSEADDR
@@ -78,56 +240,157 @@ int main(int argc, char **argv) {
   int reuse = 1;
   if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0) {
     std::cerr << "setsockopt failed\n";
-    return 1;
+    close(server_fd);
+    freeaddrinfo(result);
+    return -1;
   }
 
-  struct sockaddr_in server_addr;
-  server_addr.sin_family = AF_INET; //AF->ADDRESS FAMILY
-  server_addr.sin_addr.s_addr = INADDR_ANY; //allows the socket to bind to all available interfaces on the host machine. This means the server can accept connections on any network interface.
-  server_addr.sin_port = htons(4221); // Set port. Function htons() (host-to-network short) converts the port number from host byte order to network byte order, which is necessary because network protocols use big-endian byte order.
-
-  if (bind(server_fd, (struct sockaddr *) &server_addr, sizeof(server_addr)) != 0) {
-    std::cerr << "Failed to bind to port 4221\n";
-    return 1;
+  const bool bound = bind(server_fd, result->ai_addr, result->ai_addrlen) == 0;
+  freeaddrinfo(result);
+  if (!bound) {
+    std::cerr << "Failed to bind to " << address.host << ":" << address.port << "\n";
+    close(server_fd);
+    return -1;
   }
 
-  int connection_backlog = 5;
-  if (listen(server_fd, connection_backlog) != 0) {
+  if (listen(server_fd, backlog) != 0) {
     std::cerr << "listen failed\n";
-    return 1;
+    close(server_fd);
+    return -1;
   }
+  return server_fd;
+}
 
-  URLHandler url_handler = URLHandler();
-  url_handler.registerUrl("", std::shared_ptr<AbstractUrlAction>(new DefaultUrlAction("")));
-  url_handler.registerUrl("echo", std::shared_ptr<AbstractUrlAction>(new EchoUrlAction("echo")));
-  url_handler.registerUrl("user-agent", std::shared_ptr<AbstractUrlAction>(new UserAgentAction("user-agent")));
-  url_handler.registerUrl("files", std::shared_ptr<AbstractUrlAction>(new FileUrlAction("files")));
-
-  struct sockaddr_in client_addr;
-  int client_addr_len = sizeof(client_addr);
-  ThreadPool pool(5);
+/**
+ * @brief Accepts connections on one listening socket and hands them to the worker pool
+ */
+static void acceptLoop(const int server_fd, ThreadPool& pool, URLHandler& url_handler, const ServerConfig& config) {
+  timeval io_timeout = {};
+  io_timeout.tv_sec = config.io_timeout_ms / 1000;
+  io_timeout.tv_usec = (config.io_timeout_ms % 1000) * 1000;
 
   while (true) {
-    std::cout << "Waiting for a client to connect...\n";
-
-    const int client_fd = accept(server_fd, (struct sockaddr *) &client_addr, (socklen_t *) &client_addr_len);
+    const int client_fd = accept(server_fd, nullptr, nullptr);
     if (client_fd < 0) {
       std::cerr << "Failed to accept connection: " << strerror(errno) << std::endl;
+      continue;
+    }
+
+    // Bound how long a worker can block on a stalled client mid-request
+    if (config.io_timeout_ms > 0) {
+      setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &io_timeout, sizeof(io_timeout));
+      setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &io_timeout, sizeof(io_timeout));
     }
 
     try {
-      if (client_fd >= 0) {
-        const Server server = Server(client_fd, server_fd, url_handler);
-        pool.enqueue([server, dir] {server.sendResponse(dir);});
-        std::cout << "Client connected with fd: " << client_fd <<  std::endl;
-      }
+      const Server server = Server(client_fd, url_handler, config);
+      pool.enqueue([server, &config] {server.sendResponse(config.directory);});
+      std::cout << "Client connected with fd: " << client_fd <<  std::endl;
     } catch (const std::exception& e) {
       std::cerr << "Error handling client: " << e.what() << std::endl;
       close(client_fd);
-      close(server_fd);
-      std::cout << "Server closed successfully!" << std::endl;
     }
   }
+}
+
+int main(int argc, char **argv) {
+  // Flush after every std::cout / std::cerr
+  std::cout << std::unitbuf;
+  std::cerr << std::unitbuf;
+  
+  // You can use print statements as follows for debugging, they'll be visible when running tests.
+  std::cout << "Logs from your program will appear here!\n";
+
+  // sendfile() and splice() can't pass MSG_NOSIGNAL; a client that hangs up must
+  // fail the write, not kill the process
+  signal(SIGPIPE, SIG_IGN);
+
+  ServerConfig config;
+  try {
+    config = ServerConfig::load(argc, argv);
+  } catch (const std::exception& e) {
+    std::cerr << "Invalid configuration: " << e.what() << std::endl;
+    return 1;
+  }
+  std::cout << config.describe();
+
+  if (config.trace_sample != 0) {
+    // Block SIGUSR1 before any other thread starts so all of them inherit the mask
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    Tracer::configure(config.trace_sample);
+    startTraceDumpThread();
+  }
+
+  BufferPool::instance().setRetainedLimit(config.buffer_pool_bytes);
+  HttpResponse::setCompressionPolicy({config.compression, config.compression_level, config.compression_min_bytes});
+
+  std::vector<int> server_fds;
+  for (const ListenAddress& address : config.listen) {
+    const int server_fd = openListener(address, config.backlog);
+    if (server_fd < 0) {
+      return 1;
+    }
+    server_fds.push_back(server_fd);
+  }
+
+  URLHandler url_handler = URLHandler();
+  url_handler.registerUrl("", std::shared_ptr<AbstractUrlAction>(new DefaultUrlAction("")));
+  url_handler.registerUrl("echo", std::shared_ptr<AbstractUrlAction>(new EchoUrlAction("echo")));
+  url_handler.registerUrl("user-agent", std::shared_ptr<AbstractUrlAction>(new UserAgentAction("user-agent")));
+  auto stats_action = std::make_shared<StatsUrlAction>("stats");
+  stats_action->addSource([] { return BufferPool::instance().statsText(); });
+  std::shared_ptr<GroupCommitWriter> durable_writer;
+  if (config.durable_writes) {
+    try {
+      durable_writer = std::make_shared<GroupCommitWriter>(std::chrono::microseconds(config.group_commit_window_us),
+                                                           GroupCommitWriter::kDefaultMaxBatchSize,
+                                                           GroupCommitWriter::parseStrategy(config.group_commit_sync));
+    } catch (const std::exception& e) {
+      std::cerr << "Invalid durable write configuration: " << e.what() << std::endl;
+      return 1;
+    }
+    stats_action->addSource([durable_writer] { return durable_writer->metricsText(); });
+  }
+  url_handler.registerUrl("files", std::shared_ptr<AbstractUrlAction>(new FileUrlAction("files", durable_writer)));
+  try {
+    const BalancingStrategy balancing_strategy = UpstreamGroup::parseStrategy(config.proxy_balance);
+    for (const std::string& spec : config.proxies) {
+      registerProxy(url_handler, spec, balancing_strategy, config.max_body_bytes);
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "Invalid proxy configuration: " << e.what() << std::endl;
+    return 1;
+  }
+  if (config.cache_bytes > 0) {
+    try {
+      enableResponseCache(url_handler, *stats_action, config);
+    } catch (const std::exception& e) {
+      std::cerr << "Invalid cache configuration: " << e.what() << std::endl;
+      return 1;
+    }
+  }
+  if (Tracer::enabled()) {
+    url_handler.registerUrl("trace", std::make_shared<TraceUrlAction>("trace"));
+  }
+  if (!stats_action->empty()) {
+    url_handler.registerUrl("stats", stats_action);
+  }
+
+  ThreadPool pool(config.worker_threads);
+
+  std::cout << "Waiting for clients to connect...\n";
+  std::vector<std::thread> acceptors;
+  for (const int server_fd : server_fds) {
+    for (size_t i = 0; i < config.acceptor_threads; i++) {
+      acceptors.emplace_back(acceptLoop, server_fd, std::ref(pool), std::ref(url_handler), std::cref(config));
+    }
+  }
+  for (std::thread& acceptor : acceptors) {
+    acceptor.join();
+  }
 
   return 0;
 }
@@ -0,0 +1,296 @@
+#ifndef GROUP_COMMIT_WRITER_H
+#define GROUP_COMMIT_WRITER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * @brief How a batch of files is made durable
+ */
+enum class SyncStrategy {
+    Fdatasync, ///< One fdatasync per file in the batch
+    Syncfs     ///< A single syncfs on the filesystem holding the batch
+};
+
+/**
+ * @class GroupCommitWriter
+ * @brief Writes files durably, amortising the flush cost across concurrent writers
+ *
+ * Each write() lands in a temporary file next to its destination. A committer
+ * thread collects the temporaries that arrive within one commit window, flushes
+ * them together, renames each onto its destination and syncs the affected
+ * directories. write() returns only once its batch has committed, so a true
+ * return means the file survives a crash with either its old or new contents.
+ */
+class GroupCommitWriter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t kDefaultMaxBatchSize = 256;
+
+    struct Metrics {
+        std::atomic<uint64_t> batches{0};
+        std::atomic<uint64_t> files{0};
+        std::atomic<uint64_t> failures{0};
+        std::atomic<uint64_t> max_batch_size{0};
+        std::atomic<uint64_t> total_commit_latency_us{0};
+        std::atomic<uint64_t> max_commit_latency_us{0};
+    };
+
+    /**
+     * @param window How long the committer waits for more writes after the first one arrives
+     * @param max_batch_size A batch is committed early once it reaches this many files
+     * @param strategy Flush method used for each batch
+     */
+    explicit GroupCommitWriter(
+        std::chrono::microseconds window,
+        size_t max_batch_size = kDefaultMaxBatchSize,
+        SyncStrategy strategy = SyncStrategy::Fdatasync
+    )
+        : window_(window)
+        , max_batch_size_(max_batch_size)
+        , strategy_(strategy)
+        , committer_([this] { commitLoop(); })
+    {}
+
+    ~GroupCommitWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        condition_.notify_all();
+        committer_.join();
+    }
+
+    GroupCommitWriter(const GroupCommitWriter&) = delete;
+    GroupCommitWriter& operator=(const GroupCommitWriter&) = delete;
+
+    /**
+     * @brief Parses a sync strategy name ("fdatasync" or "syncfs")
+     * @throws std::invalid_argument for unknown names
+     */
+    static SyncStrategy parseStrategy(const std::string& name) {
+        if (name == "fdatasync") {
+            return SyncStrategy::Fdatasync;
+        }
+        if (name == "syncfs") {
+            return SyncStrategy::Syncfs;
+        }
+        throw std::invalid_argument("Unknown sync strategy '" + name + "'");
+    }
+
+    /**
+     * @brief Durably replaces the file at path with data
+     *
+     * @param path Destination file
+     * @param data File contents
+     * @return bool true once the file is committed, false on any failure
+     */
+    bool write(const std::string& path, const std::string& data) {
+        PendingWrite pending;
+        pending.final_path = path;
+        pending.temp_path = path + ".tmp." + std::to_string(getpid()) + "."
+                          + std::to_string(temp_counter_.fetch_add(1, std::memory_order_relaxed));
+        pending.fd = open(pending.temp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (pending.fd < 0) {
+            std::cerr << "Failed to create " << pending.temp_path << ": " << strerror(errno) << '\n';
+            metrics_.failures.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (!writeAll(pending.fd, data)) {
+            std::cerr << "Failed to write " << pending.temp_path << ": " << strerror(errno) << '\n';
+            discard(pending);
+            metrics_.failures.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        // Commit latency runs from queueing to commit; writing the temporary is excluded
+        const auto queued_at = Clock::now();
+        std::future<bool> committed = pending.committed.get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (queue_.empty()) {
+                batch_opened_at_ = queued_at;
+            }
+            queue_.push_back(std::move(pending));
+        }
+        condition_.notify_one();
+
+        const bool ok = committed.get();
+        recordLatency(queued_at);
+        if (!ok) {
+            metrics_.failures.fetch_add(1, std::memory_order_relaxed);
+        }
+        return ok;
+    }
+
+    [[nodiscard]] const Metrics& metrics() const {
+        return metrics_;
+    }
+
+    /**
+     * @brief Renders the metrics as "name value" lines
+     */
+    [[nodiscard]] std::string metricsText() const {
+        const uint64_t batches = metrics_.batches.load(std::memory_order_relaxed);
+        const uint64_t files = metrics_.files.load(std::memory_order_relaxed);
+        const uint64_t total_latency = metrics_.total_commit_latency_us.load(std::memory_order_relaxed);
+
+        std::ostringstream out;
+        out << "group_commit_batches " << batches << '\n'
+            << "group_commit_files " << files << '\n'
+            << "group_commit_failures " << metrics_.failures.load(std::memory_order_relaxed) << '\n'
+            << "group_commit_batch_size_avg " << (batches ? static_cast<double>(files) / batches : 0.0) << '\n'
+            << "group_commit_batch_size_max " << metrics_.max_batch_size.load(std::memory_order_relaxed) << '\n'
+            << "group_commit_latency_us_avg " << (files ? total_latency / files : 0) << '\n'
+            << "group_commit_latency_us_max " << metrics_.max_commit_latency_us.load(std::memory_order_relaxed) << '\n';
+        return out.str();
+    }
+
+private:
+    struct PendingWrite {
+        int fd = -1;
+        std::string temp_path;
+        std::string final_path;
+        std::promise<bool> committed;
+    };
+
+    std::chrono::microseconds window_;
+    size_t max_batch_size_;
+    SyncStrategy strategy_;
+
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::vector<PendingWrite> queue_;
+    Clock::time_point batch_opened_at_;
+    bool stop_ = false;
+
+    std::atomic<uint64_t> temp_counter_{0};
+    Metrics metrics_;
+    std::thread committer_; // Declared last so it starts after every other member is initialised
+
+    static bool writeAll(const int fd, const std::string& data) {
+        size_t written = 0;
+        while (written < data.size()) {
+            const ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            written += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    static void discard(PendingWrite& pending) {
+        close(pending.fd);
+        unlink(pending.temp_path.c_str());
+    }
+
+    static std::string parentDirectory(const std::string& path) {
+        const std::string parent = std::filesystem::path(path).parent_path().string();
+        return parent.empty() ? "." : parent;
+    }
+
+    static bool syncDirectory(const std::string& directory) {
+        const int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        const bool ok = fsync(fd) == 0;
+        close(fd);
+        return ok;
+    }
+
+    void recordLatency(const Clock::time_point start) {
+        const auto latency = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count());
+        metrics_.total_commit_latency_us.fetch_add(latency, std::memory_order_relaxed);
+        uint64_t max = metrics_.max_commit_latency_us.load(std::memory_order_relaxed);
+        while (latency > max && !metrics_.max_commit_latency_us.compare_exchange_weak(max, latency)) {}
+    }
+
+    void commitLoop() {
+        while (true) {
+            std::vector<PendingWrite> batch;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                condition_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+                if (stop_ && queue_.empty()) {
+                    return;
+                }
+                // Hold the batch open for one window so concurrent writers can join it
+                condition_.wait_until(lock, batch_opened_at_ + window_, [this] {
+                    return stop_ || queue_.size() >= max_batch_size_;
+                });
+                batch.swap(queue_);
+            }
+            commit(batch);
+        }
+    }
+
+    void commit(std::vector<PendingWrite>& batch) {
+        std::vector<bool> ok(batch.size(), true);
+
+        if (strategy_ == SyncStrategy::Syncfs) {
+            // One flush for the whole filesystem; any file in the batch identifies it
+            const bool synced = syncfs(batch.front().fd) == 0;
+            ok.assign(batch.size(), synced);
+        } else {
+            for (size_t i = 0; i < batch.size(); i++) {
+                ok[i] = fdatasync(batch[i].fd) == 0;
+            }
+        }
+
+        std::set<std::string> directories;
+        for (size_t i = 0; i < batch.size(); i++) {
+            PendingWrite& pending = batch[i];
+            close(pending.fd);
+            if (ok[i] && rename(pending.temp_path.c_str(), pending.final_path.c_str()) == 0) {
+                directories.insert(parentDirectory(pending.final_path));
+            } else {
+                std::cerr << "Failed to commit " << pending.final_path << ": " << strerror(errno) << '\n';
+                unlink(pending.temp_path.c_str());
+                ok[i] = false;
+            }
+        }
+
+        // Renames are only durable once their directory entries are flushed
+        std::set<std::string> failed_directories;
+        for (const std::string& directory : directories) {
+            if (!syncDirectory(directory)) {
+                failed_directories.insert(directory);
+            }
+        }
+
+        for (size_t i = 0; i < batch.size(); i++) {
+            const bool committed = ok[i] && !failed_directories.contains(parentDirectory(batch[i].final_path));
+            batch[i].committed.set_value(committed);
+        }
+
+        metrics_.batches.fetch_add(1, std::memory_order_relaxed);
+        metrics_.files.fetch_add(batch.size(), std::memory_order_relaxed);
+        uint64_t max = metrics_.max_batch_size.load(std::memory_order_relaxed);
+        while (batch.size() > max && !metrics_.max_batch_size.compare_exchange_weak(max, batch.size())) {}
+    }
+};
+
+#endif //GROUP_COMMIT_WRITER_H
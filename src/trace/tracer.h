@@ -0,0 +1,328 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/syscall.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * @brief Request-processing phases recorded by the tracer
+ */
+enum class TracePhase : uint8_t {
+    Recv,
+    Parse,
+    Route,
+    Execute,
+    Compress,
+    Serialize,
+    Send
+};
+
+/**
+ * @class Tracer
+ * @brief Samples requests and records the duration of each processing phase
+ *
+ * Every thread appends to its own fixed-size ring buffer, so recording never
+ * takes a lock; when a ring wraps, the oldest events are overwritten. Timestamps
+ * are raw TSC ticks (steady_clock nanoseconds on non-x86 targets) and are only
+ * converted to wall time when the rings are exported as Chrome trace JSON,
+ * which chrome://tracing and ui.perfetto.dev both load.
+ *
+ * While tracing is disabled, beginRequest() and each TraceSpan cost one
+ * well-predicted branch.
+ */
+class Tracer {
+public:
+    /**
+     * @brief Enables tracing of one in every sample_every requests (0 disables)
+     */
+    static void configure(uint32_t sample_every) {
+        calibration_ticks_ = readTicks();
+        calibration_time_ = std::chrono::steady_clock::now();
+        sample_every_.store(sample_every, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] static bool enabled() {
+        return sample_every_.load(std::memory_order_relaxed) != 0;
+    }
+
+    /**
+     * @brief Decides whether the request about to be processed on this thread is traced
+     */
+    static void beginRequest() {
+        const uint32_t sample_every = sample_every_.load(std::memory_order_relaxed);
+        if (sample_every == 0) [[likely]] {
+            return;
+        }
+        current_request_ = ++sample_counter_ % sample_every == 0
+            ? next_request_id_.fetch_add(1, std::memory_order_relaxed)
+            : 0;
+    }
+
+    static void endRequest() {
+        current_request_ = 0;
+    }
+
+    /**
+     * @brief Ends a request that turned out not to exist (e.g. the client closed
+     *        the connection), discarding its events and returning its sample slot
+     */
+    static void abandonRequest() {
+        if (sample_every_.load(std::memory_order_relaxed) == 0) [[likely]] {
+            return;
+        }
+        sample_counter_--;
+        if (current_request_ != 0) {
+            localRing().discardTail(current_request_);
+            current_request_ = 0;
+        }
+    }
+
+    [[nodiscard]] static uint64_t currentRequest() {
+        return current_request_;
+    }
+
+    [[nodiscard]] static uint64_t readTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    static void record(TracePhase phase, uint64_t start_ticks, uint64_t end_ticks) {
+        localRing().push({start_ticks, end_ticks, current_request_, phase});
+    }
+
+    /**
+     * @brief Exports every thread's ring as Chrome trace event JSON
+     */
+    [[nodiscard]] static std::string exportChromeTrace() {
+        // Ticks per microsecond, measured between configure() and now
+        const uint64_t now_ticks = readTicks();
+        const auto elapsed = std::chrono::steady_clock::now() - calibration_time_;
+        const double elapsed_us = std::chrono::duration<double, std::micro>(elapsed).count();
+        const double ticks_per_us = elapsed_us > 0 ? (now_ticks - calibration_ticks_) / elapsed_us : 1.0;
+
+        std::vector<std::shared_ptr<Ring>> rings;
+        {
+            std::lock_guard<std::mutex> lock(rings_mutex_);
+            rings = rings_;
+        }
+
+        // ts and dur are microseconds; three fixed decimals keep nanosecond resolution,
+        // where the default six significant digits would round ts to whole
+        // milliseconds once the server has been up for a few minutes
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(3);
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool first = true;
+        const pid_t pid = getpid();
+        for (const auto& ring : rings) {
+            for (const Event& event : ring->snapshot()) {
+                out << (first ? "" : ",")
+                    << "{\"name\":\"" << phaseName(event.phase) << "\",\"cat\":\"http\",\"ph\":\"X\""
+                    << ",\"ts\":" << (event.start_ticks - calibration_ticks_) / ticks_per_us
+                    << ",\"dur\":" << (event.end_ticks - event.start_ticks) / ticks_per_us
+                    << ",\"pid\":" << pid << ",\"tid\":" << ring->thread_id
+                    << ",\"args\":{\"request\":" << event.request_id << "}}";
+                first = false;
+            }
+        }
+        out << "]}";
+        return out.str();
+    }
+
+private:
+    struct Event {
+        uint64_t start_ticks;
+        uint64_t end_ticks;
+        uint64_t request_id;
+        TracePhase phase;
+    };
+
+    /**
+     * @brief One ring entry, guarded by a per-slot sequence lock
+     *
+     * Only the owning thread writes a slot; exporters read it concurrently. All
+     * fields are atomics so those reads are never a data race. The version is odd
+     * while a write is in progress and only ever grows, so a reader that sees the
+     * same even version before and after copying the fields has a consistent event.
+     */
+    struct Slot {
+        std::atomic<uint64_t> version{0};
+        std::atomic<uint64_t> index{0};      ///< Position in the ring's event sequence
+        std::atomic<uint64_t> start_ticks{0};
+        std::atomic<uint64_t> end_ticks{0};
+        std::atomic<uint64_t> request_id{0};
+        std::atomic<TracePhase> phase{TracePhase::Recv};
+        std::atomic<bool> discarded{false};
+
+        void beginWrite() {
+            version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        void endWrite() {
+            version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        /**
+         * @brief Copies the event stored for position expected_index
+         * @return false if the slot was being written, now holds a different
+         *         event or the event was discarded
+         */
+        bool read(uint64_t expected_index, Event& event) const {
+            const uint64_t before = version.load(std::memory_order_acquire);
+            if (before % 2 != 0) {
+                return false;
+            }
+            const uint64_t stored_index = index.load(std::memory_order_relaxed);
+            const bool was_discarded = discarded.load(std::memory_order_relaxed);
+            event = {start_ticks.load(std::memory_order_relaxed), end_ticks.load(std::memory_order_relaxed),
+                     request_id.load(std::memory_order_relaxed), phase.load(std::memory_order_relaxed)};
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return version.load(std::memory_order_relaxed) == before
+                && stored_index == expected_index && !was_discarded;
+        }
+    };
+
+    struct Ring {
+        static constexpr size_t kCapacity = 16384;
+
+        std::array<Slot, kCapacity> slots;
+        std::atomic<uint64_t> head{0}; ///< Number of events ever pushed; only grows
+        long thread_id = syscall(SYS_gettid);
+
+        void push(const Event& event) {
+            const uint64_t position = head.load(std::memory_order_relaxed);
+            Slot& slot = slots[position % kCapacity];
+            slot.beginWrite();
+            slot.index.store(position, std::memory_order_relaxed);
+            slot.start_ticks.store(event.start_ticks, std::memory_order_relaxed);
+            slot.end_ticks.store(event.end_ticks, std::memory_order_relaxed);
+            slot.request_id.store(event.request_id, std::memory_order_relaxed);
+            slot.phase.store(event.phase, std::memory_order_relaxed);
+            slot.discarded.store(false, std::memory_order_relaxed);
+            slot.endWrite();
+            head.store(position + 1, std::memory_order_release);
+        }
+
+        /**
+         * @brief Marks the most recent events as discarded if they belong to request_id
+         *
+         * head is left alone: moving it back would let a concurrent snapshot
+         * mistake reused positions for the events it already started copying.
+         */
+        void discardTail(uint64_t request_id) {
+            const uint64_t end = head.load(std::memory_order_relaxed);
+            const uint64_t oldest = end > kCapacity ? end - kCapacity : 0;
+            for (uint64_t position = end; position > oldest; position--) {
+                Slot& slot = slots[(position - 1) % kCapacity];
+                // Only this thread writes its slots, so a relaxed read sees the latest values
+                if (slot.discarded.load(std::memory_order_relaxed)
+                    || slot.request_id.load(std::memory_order_relaxed) != request_id) {
+                    break;
+                }
+                slot.beginWrite();
+                slot.discarded.store(true, std::memory_order_relaxed);
+                slot.endWrite();
+            }
+        }
+
+        /**
+         * @brief Copies the recorded events, skipping any the owner thread
+         *        overwrote or discarded while the copy was in progress
+         */
+        [[nodiscard]] std::vector<Event> snapshot() const {
+            const uint64_t end = head.load(std::memory_order_acquire);
+            const uint64_t begin = end > kCapacity ? end - kCapacity : 0;
+            std::vector<Event> copy;
+            copy.reserve(end - begin);
+            Event event;
+            for (uint64_t position = begin; position < end; position++) {
+                if (slots[position % kCapacity].read(position, event)) {
+                    copy.push_back(event);
+                }
+            }
+            return copy;
+        }
+    };
+
+    static inline std::atomic<uint32_t> sample_every_{0};
+    static inline std::atomic<uint64_t> next_request_id_{1};
+    static inline uint64_t calibration_ticks_ = 0;
+    static inline std::chrono::steady_clock::time_point calibration_time_;
+
+    static inline std::mutex rings_mutex_;
+    static inline std::vector<std::shared_ptr<Ring>> rings_;
+
+    static inline thread_local uint64_t current_request_ = 0;
+    static inline thread_local uint32_t sample_counter_ = 0;
+
+    static Ring& localRing() {
+        // Rings stay registered after their thread exits so their events can still be exported
+        thread_local std::shared_ptr<Ring> ring = [] {
+            auto created = std::make_shared<Ring>();
+            std::lock_guard<std::mutex> lock(rings_mutex_);
+            rings_.push_back(created);
+            return created;
+        }();
+        return *ring;
+    }
+
+    static const char* phaseName(TracePhase phase) {
+        switch (phase) {
+            case TracePhase::Recv: return "recv";
+            case TracePhase::Parse: return "parse";
+            case TracePhase::Route: return "route";
+            case TracePhase::Execute: return "execute";
+            case TracePhase::Compress: return "compress";
+            case TracePhase::Serialize: return "serialize";
+            case TracePhase::Send: return "send";
+        }
+        return "unknown";
+    }
+};
+
+/**
+ * @class TraceSpan
+ * @brief Records the lifetime of the enclosing scope as one phase of the current request
+ */
+class TraceSpan {
+public:
+    explicit TraceSpan(TracePhase phase) : phase_(phase) {
+        if (Tracer::currentRequest() != 0) [[unlikely]] {
+            start_ticks_ = Tracer::readTicks();
+        }
+    }
+
+    ~TraceSpan() {
+        if (start_ticks_ != 0) [[unlikely]] {
+            Tracer::record(phase_, start_ticks_, Tracer::readTicks());
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    TracePhase phase_;
+    uint64_t start_ticks_ = 0;
+};
+
+#endif //TRACER_H
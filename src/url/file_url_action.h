@@ -4,17 +4,24 @@
 
 #ifndef FILE_URL_ACTION_H
 #define FILE_URL_ACTION_H
-#include <filesystem>
 #include <fstream>
+#include <memory>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include "abstract_url_action.h"
 #include "../response/http_response.h"
-
-namespace fs = std::filesystem;
+#include "../storage/group_commit_writer.h"
 
 class FileUrlAction: public AbstractUrlAction {
 public:
-    explicit FileUrlAction(const std::string &resource_name)
-        : AbstractUrlAction(resource_name) {
+    /**
+     * @param resource_name Route prefix
+     * @param durable_writer When set, POST bodies are committed through it and
+     *                       201 is only returned once the file is durable
+     */
+    explicit FileUrlAction(const std::string &resource_name,
+                           std::shared_ptr<GroupCommitWriter> durable_writer = nullptr)
+        : AbstractUrlAction(resource_name), durable_writer_(std::move(durable_writer)) {
     }
 
     [[nodiscard]] HttpResponse execute(const HttpRequest &http_request) const override {
@@ -29,34 +36,58 @@ public:
         }
     }
 private:
+    std::shared_ptr<GroupCommitWriter> durable_writer_;
+
     [[nodiscard]] static HttpResponse executeGetRequest(const HttpRequest &http_request) {
         const std:: string filename = http_request.directory_name + http_request.request_param;
 
-        if (doesFileExist(filename)) {
-            return returnFileResponse(filename, http_request.headers);
+        const int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return returnFileNotFindResponse(http_request.headers);
         }
-        return returnFileNotFindResponse(http_request.headers);
+        auto file = std::make_shared<FileHandle>(fd);
+
+        struct stat file_stat = {};
+        if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+            return returnFileNotFindResponse(http_request.headers);
+        }
+        return returnFileResponse(std::move(file), static_cast<size_t>(file_stat.st_size), http_request.headers);
     }
 
-    [[nodiscard]] static HttpResponse executePostRequest(const HttpRequest &http_request) {
+    [[nodiscard]] HttpResponse executePostRequest(const HttpRequest &http_request) const {
         const std:: string file = http_request.directory_name + http_request.request_param;
 
+        if (durable_writer_) {
+            if (!durable_writer_->write(file, http_request.body)) {
+                return returnWriteFailedResponse(http_request.headers);
+            }
+            return {"Created", 201, "application/octet-stream", 0, "", http_request.headers};
+        }
+
         // Create and write to the file
         std::ofstream outfile(file);
-        if (outfile.is_open()) {
-            outfile << http_request.body;
-            outfile.close();
-            std::cout << "File created successfully: " << file << '\n';
-        } else {
+        if (!outfile.is_open()) {
             std::cerr << "Failed to create the file: " << file << '\n';
+            return returnWriteFailedResponse(http_request.headers);
+        }
+        outfile << http_request.body;
+        outfile.close();
+        if (outfile.fail()) {
+            std::cerr << "Failed to write the file: " << file << '\n';
+            return returnWriteFailedResponse(http_request.headers);
         }
+        std::cout << "File created successfully: " << file << '\n';
         return {"Created", 201, "application/octet-stream", 0, "", http_request.headers};
     }
 
-    static HttpResponse returnFileResponse(const std::string &filename, std::unordered_map<std::string, std::string> headers) {
+    static HttpResponse returnWriteFailedResponse(std::unordered_map<std::string, std::string> headers) {
+        const std::string message = "Internal Server Error";
+        return {message, 500, "application/octet-stream", 0, "", headers};
+    }
+
+    static HttpResponse returnFileResponse(std::shared_ptr<FileHandle> file, size_t size, std::unordered_map<std::string, std::string> headers) {
         const std::string message = "OK";
-        const std::string content = readDataFromTheFile(filename);
-        return {message, 200, "application/octet-stream", content.length(), content, headers};
+        return {message, 200, "application/octet-stream", ResponseBody::file({std::move(file), 0, size}), headers};
     }
 
     static HttpResponse returnFileNotFindResponse(std::unordered_map<std::string, std::string> headers) {
@@ -64,29 +95,6 @@ private:
         return {message, 404, "application/octet-stream", 0, "", headers};
     }
 
-    static bool doesFileExist(const std::string& filename) {
-        return fs::exists(filename);
-    }
-
-    static std::string readDataFromTheFile(const std::string &filename) {
-        if (!doesFileExist(filename)) {
-            throw std::runtime_error("File does not exist!");
-        }
-
-        auto fileSize = fs::file_size(filename);
-
-        std::ifstream file(filename, std::ios::in | std::ios::binary);
-
-        if (!file.is_open()) {
-            std::cerr << "Error: Could not open the file." << std::endl;
-        }
-
-        std::string fileContents(fileSize, '\0');
-        file.read(fileContents.data(), fileSize);
-
-        file.close();
-        return fileContents;
-    }
 };
 
 #endif //FILE_URL_ACTION_H
@@ -0,0 +1,499 @@
+#ifndef PROXY_URL_ACTION_H
+#define PROXY_URL_ACTION_H
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "abstract_url_action.h"
+#include "../proxy/upstream_group.h"
+#include "../request/http_request.h"
+#include "../response/http_response.h"
+
+/**
+ * @class ProxyUrlAction
+ * @brief Forwards requests under a registered prefix to a group of upstream servers
+ *
+ * The prefix is stripped before forwarding, so "/api/users" registered as "api"
+ * reaches the upstream as "/users"; the rest of the path and the query are kept
+ * byte for byte. Upstream connections are kept alive and reused
+ * across requests. Complete upstream responses, 5xx included, are passed through
+ * and count as healthy exchanges; only failures to connect or to read a response
+ * mark an upstream down. Large Content-Length bodies are not read here: the
+ * response keeps the upstream connection and the response writer splices the
+ * rest of the body straight to the client, then returns the connection to the pool.
+ * Until then the connection stays with the response, so a pipelined batch holds
+ * one upstream connection per spliced body.
+ * A request is retried only when no connection could be opened, or, for
+ * idempotent methods, when the exchange broke (e.g. the upstream closed a reused
+ * connection while it was idle); a non-idempotent request is never sent twice.
+ */
+class ProxyUrlAction : public AbstractUrlAction {
+public:
+    /**
+     * @param resource_name Route prefix to strip before forwarding
+     * @param upstreams Backends to balance between
+     * @param max_body_bytes Largest upstream response body accepted; larger ones fail with 502
+     */
+    ProxyUrlAction(const std::string &resource_name, std::shared_ptr<UpstreamGroup> upstreams, size_t max_body_bytes)
+      : AbstractUrlAction(resource_name), upstreams_(std::move(upstreams)), max_body_bytes_(max_body_bytes) {
+    }
+
+    [[nodiscard]] HttpResponse execute(const HttpRequest &http_request) const override {
+        const std::string upstream_request = buildUpstreamRequest(http_request, upstreamTarget(http_request));
+        const bool idempotent = isIdempotent(http_request.method);
+
+        Upstream* previous = nullptr;
+        for (int attempt = 0; attempt < kMaxAttempts; attempt++) {
+            Upstream* upstream = upstreams_->select(previous);
+            if (upstream == nullptr) {
+                return errorResponse(503, "Service Unavailable", http_request);
+            }
+
+            upstream->active_requests.fetch_add(1, std::memory_order_relaxed);
+            UpstreamResponse response;
+            const ExchangeResult result = exchange(*upstream, upstream_request, http_request.method,
+                                                  max_body_bytes_, response);
+            upstream->active_requests.fetch_sub(1, std::memory_order_relaxed);
+
+            switch (result) {
+                case ExchangeResult::Ok:
+                    // A complete response is passed through whatever its status. A 5xx
+                    // still proves the upstream reachable, and is often the application
+                    // refusing one request, so only connect and I/O failures count
+                    // against its health
+                    UpstreamGroup::recordSuccess(*upstream);
+                    return toClientResponse(response, *upstream, http_request);
+                case ExchangeResult::ConnectFailed:
+                    // Nothing was sent, so any request may go to the next upstream
+                    upstreams_->recordFailure(*upstream);
+                    previous = upstream;
+                    break;
+                case ExchangeResult::StaleConnection:
+                    // The pooled socket was dead; don't blame the upstream, but the request
+                    // may still have reached it, so only an idempotent one is replayed
+                    if (!idempotent) {
+                        return errorResponse(502, "Bad Gateway", http_request);
+                    }
+                    break;
+                case ExchangeResult::TooLarge:
+                    // The upstream behaved; its answer just doesn't fit in memory
+                    return errorResponse(502, "Bad Gateway", http_request);
+                case ExchangeResult::Failed:
+                    upstreams_->recordFailure(*upstream);
+                    if (!idempotent) {
+                        return errorResponse(502, "Bad Gateway", http_request);
+                    }
+                    previous = upstream;
+                    break;
+            }
+        }
+
+        return errorResponse(502, "Bad Gateway", http_request);
+    }
+
+private:
+    std::shared_ptr<UpstreamGroup> upstreams_;
+    size_t max_body_bytes_;
+
+    static constexpr int kMaxAttempts = 3;
+    static constexpr size_t kMaxHeaderBytes = 64 * 1024;
+    static constexpr size_t kReadChunkSize = 16384;
+    // Bodies with at least this much left unread after the head are spliced rather than buffered
+    static constexpr size_t kSpliceMinBytes = 64 * 1024;
+    static constexpr const char* CARRIAGE_DELIMITER = "\r\n";
+    static constexpr const char* HEADER_TERMINATOR = "\r\n\r\n";
+
+    enum class ExchangeResult {
+        Ok,              ///< A complete response was read, whatever its status
+        ConnectFailed,   ///< No connection could be opened; nothing was sent
+        StaleConnection, ///< A pooled socket failed before any response bytes arrived
+        TooLarge,        ///< The response exceeded the header or body size limit
+        Failed           ///< The exchange broke after the request was (partly) sent
+    };
+
+    struct UpstreamResponse {
+        int status_code = 0;
+        std::string message;
+        std::string content_type = "application/octet-stream";
+        std::string body;
+        bool keep_alive = true;
+        bool too_large = false;
+        // Body bytes still on the connection after those in body; the connection is then left open
+        size_t unread_length = 0;
+        int fd = -1;
+        // End-to-end headers to forward, in upstream order; repeated names (Set-Cookie) are kept
+        std::vector<std::pair<std::string, std::string>> headers;
+    };
+
+    [[nodiscard]] HttpResponse toClientResponse(UpstreamResponse &response, Upstream &upstream,
+                                                const HttpRequest &http_request) const {
+        ResponseBody body = ResponseBody::owned(std::move(response.body));
+        if (response.unread_length > 0) {
+            // The group is captured only to keep the upstream alive until the body is sent
+            auto release = [group = upstreams_, &upstream, keep_alive = response.keep_alive](int fd, bool drained) {
+                if (drained && keep_alive) {
+                    upstream.releaseConnection(fd);
+                } else {
+                    close(fd);
+                }
+            };
+            body = ResponseBody::socket({std::make_shared<SocketHandle>(response.fd, std::move(release)),
+                                         std::string(body.bytes()), response.unread_length});
+        }
+        HttpResponse client_response(response.message, response.status_code, response.content_type,
+                                     std::move(body), http_request.headers);
+        for (auto &[name, value] : response.headers) {
+            client_response.addHeader(std::move(name), std::move(value));
+        }
+        return client_response;
+    }
+
+    static HttpResponse errorResponse(int status_code, const std::string &message, const HttpRequest &http_request) {
+        return {message, status_code, "text/plain", 0, "", http_request.headers};
+    }
+
+    /**
+     * @brief Methods that may be replayed after the upstream could have seen them (RFC 9110 9.2.2)
+     */
+    static bool isIdempotent(const std::string &method) {
+        static const std::string kIdempotent[] = {"GET", "HEAD", "OPTIONS", "TRACE", "PUT", "DELETE"};
+        return std::ranges::find(kIdempotent, method) != std::end(kIdempotent);
+    }
+
+    static std::string toLower(std::string value) {
+        std::ranges::transform(value, value.begin(), [](unsigned char c) { return std::tolower(c); });
+        return value;
+    }
+
+    /**
+     * @brief Hop-by-hop headers describe a single connection and are not forwarded in
+     *        either direction; Content-Length is regenerated for the forwarded body
+     */
+    static bool isHopByHopHeader(const std::string &name) {
+        static const std::string kHopByHop[] = {
+            "connection", "keep-alive", "proxy-connection", "proxy-authenticate",
+            "proxy-authorization", "te", "trailer", "transfer-encoding", "upgrade",
+            "content-length", "host"
+        };
+        const std::string lower = toLower(name);
+        return std::ranges::find(kHopByHop, lower) != std::end(kHopByHop);
+    }
+
+    /**
+     * @brief Whether a comma-separated, lower-case token list contains token
+     */
+    static bool listContains(const std::string &list, const std::string &token) {
+        size_t start = 0;
+        while (start <= list.size()) {
+            size_t end = list.find(',', start);
+            if (end == std::string::npos) {
+                end = list.size();
+            }
+            const size_t first = list.find_first_not_of(' ', start);
+            const size_t last = list.find_last_not_of(' ', end - 1);
+            if (first < end && last != std::string::npos && list.compare(first, last - first + 1, token) == 0) {
+                return true;
+            }
+            start = end + 1;
+        }
+        return false;
+    }
+
+    /**
+     * @brief The request target to send upstream: the raw path after the route prefix
+     *
+     * request_param can't be used: routing trims its trailing '/', which would turn
+     * "/api/dir/" into "/dir" and "/api/x?q=/" into "/x?q=".
+     */
+    [[nodiscard]] std::string upstreamTarget(const HttpRequest &http_request) const {
+        std::string_view remainder(http_request.path);
+        remainder.remove_prefix(std::min(resource_name.size(), remainder.size()));
+        if (remainder.starts_with('/')) {
+            remainder.remove_prefix(1);
+        }
+        return "/" + std::string(remainder);
+    }
+
+    [[nodiscard]] static std::string buildUpstreamRequest(const HttpRequest &http_request, const std::string &target) {
+        std::string request;
+        request.reserve(256 + http_request.body.size());
+        request.append(http_request.method).append(" ").append(target)
+               .append(" HTTP/1.1").append(CARRIAGE_DELIMITER);
+
+        const auto host = http_request.headers.find("Host");
+        if (host != http_request.headers.end()) {
+            request.append("Host: ").append(host->second).append(CARRIAGE_DELIMITER);
+        }
+        for (const auto &[name, value] : http_request.headers) {
+            // The body is sent right away, so the client's Expect would only draw a 100 Continue
+            if (!isHopByHopHeader(name) && toLower(name) != "expect") {
+                request.append(name).append(": ").append(value).append(CARRIAGE_DELIMITER);
+            }
+        }
+        if (!http_request.body.empty() || http_request.method == "POST" || http_request.method == "PUT") {
+            request.append("Content-Length: ").append(std::to_string(http_request.body.size()))
+                   .append(CARRIAGE_DELIMITER);
+        }
+        request.append("Connection: keep-alive").append(CARRIAGE_DELIMITER);
+        request.append(CARRIAGE_DELIMITER);
+        request.append(http_request.body);
+        return request;
+    }
+
+    /**
+     * @brief Sends one request on a pooled connection and reads the response
+     *
+     * If the body is left unread for splicing, the connection is handed to the
+     * response (response.fd) instead of going back to the pool.
+     */
+    static ExchangeResult exchange(Upstream &upstream, const std::string &request, const std::string &method,
+                                   const size_t max_body_bytes, UpstreamResponse &response) {
+        bool reused = false;
+        const int fd = upstream.acquireConnection(reused);
+        if (fd < 0) {
+            return ExchangeResult::ConnectFailed;
+        }
+
+        std::string buffer;
+        const bool ok = sendAll(fd, request) && readResponse(fd, method, max_body_bytes, buffer, response);
+        if (!ok) {
+            close(fd);
+            if (response.too_large) {
+                return ExchangeResult::TooLarge;
+            }
+            // Nothing came back on a reused socket: the upstream closed it while idle
+            return reused && buffer.empty() ? ExchangeResult::StaleConnection : ExchangeResult::Failed;
+        }
+
+        if (response.unread_length > 0) {
+            response.fd = fd;
+        } else if (response.keep_alive) {
+            upstream.releaseConnection(fd);
+        } else {
+            close(fd);
+        }
+        return ExchangeResult::Ok;
+    }
+
+    static bool sendAll(const int fd, const std::string &data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            const ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                return false;
+            }
+            sent += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Appends up to kReadChunkSize bytes from the socket to buffer
+     * @return ssize_t Bytes read, 0 on orderly shutdown, negative on error
+     */
+    static ssize_t readSome(const int fd, std::string &buffer) {
+        const size_t old_size = buffer.size();
+        buffer.resize(old_size + kReadChunkSize);
+        const ssize_t n = recv(fd, buffer.data() + old_size, kReadChunkSize, 0);
+        buffer.resize(old_size + std::max<ssize_t>(n, 0));
+        return n;
+    }
+
+    static bool readResponse(const int fd, const std::string &method, const size_t max_body_bytes,
+                             std::string &buffer, UpstreamResponse &response) {
+        size_t header_end;
+        std::unordered_map<std::string, std::string> headers;
+        while (true) {
+            while ((header_end = buffer.find(HEADER_TERMINATOR)) == std::string::npos) {
+                if (buffer.size() > kMaxHeaderBytes) {
+                    response.too_large = true;
+                    return false;
+                }
+                if (readSome(fd, buffer) <= 0) {
+                    return false;
+                }
+            }
+
+            headers.clear();
+            response.headers.clear();
+            if (!parseHead(buffer.substr(0, header_end), response, headers)) {
+                return false;
+            }
+            if (response.status_code >= 200) {
+                break;
+            }
+            if (response.status_code == 101) {
+                return false; // Upgrade is never forwarded, so a switch of protocols is a protocol error
+            }
+            // Interim response (e.g. 100 Continue): skip it and wait for the final one
+            buffer.erase(0, header_end + 4);
+        }
+        if (headers.contains("content-type")) {
+            response.content_type = headers["content-type"];
+        }
+        if (headers.contains("connection")) {
+            // Connection also names further hop-by-hop headers that must not be forwarded
+            const std::string connection = toLower(headers["connection"]);
+            std::erase_if(response.headers, [&connection](const auto &header) {
+                return listContains(connection, toLower(header.first));
+            });
+            if (listContains(connection, "close")) {
+                response.keep_alive = false;
+            }
+        }
+
+        // The body starts right after the header block; reuse the buffer for it
+        buffer.erase(0, header_end + 4);
+
+        if (method == "HEAD" || response.status_code == 204 || response.status_code == 304) {
+            response.body.clear();
+            return buffer.empty();
+        }
+        if (headers.contains("transfer-encoding") && toLower(headers["transfer-encoding"]) != "identity") {
+            return readChunkedBody(fd, max_body_bytes, buffer, response);
+        }
+        if (headers.contains("content-length")) {
+            size_t length;
+            if (!parseContentLength(headers["content-length"], length)) {
+                return false; // Unframeable response; the connection is out of sync
+            }
+            if (length > max_body_bytes) {
+                response.too_large = true;
+                return false;
+            }
+            if (buffer.size() < length && length - buffer.size() >= kSpliceMinBytes) {
+                response.unread_length = length - buffer.size();
+                response.body = std::move(buffer);
+                return true;
+            }
+            while (buffer.size() < length) {
+                if (readSome(fd, buffer) <= 0) {
+                    return false;
+                }
+            }
+            if (buffer.size() != length) {
+                return false; // Unsolicited trailing bytes; the connection is out of sync
+            }
+            response.body = std::move(buffer);
+            return true;
+        }
+
+        // No framing: the body is delimited by the upstream closing the connection
+        ssize_t n;
+        while ((n = readSome(fd, buffer)) > 0) {
+            if (buffer.size() > max_body_bytes) {
+                response.too_large = true;
+                return false;
+            }
+        }
+        response.body = std::move(buffer);
+        response.keep_alive = false;
+        return n == 0;
+    }
+
+    /**
+     * @brief Parses a Content-Length value without throwing on malformed input
+     */
+    static bool parseContentLength(const std::string &value, size_t &length) {
+        const char* end = value.data() + value.size();
+        const auto [parsed_end, error] = std::from_chars(value.data(), end, length);
+        return error == std::errc() && parsed_end == end && !value.empty();
+    }
+
+    static bool parseHead(const std::string &head, UpstreamResponse &response,
+                          std::unordered_map<std::string, std::string> &headers) {
+        // Status line: HTTP/1.1 <code> <message>
+        const size_t line_end = head.find(CARRIAGE_DELIMITER);
+        const std::string status_line = head.substr(0, line_end);
+        const size_t code_start = status_line.find(' ');
+        if (code_start == std::string::npos) {
+            return false;
+        }
+        const size_t code_end = status_line.find(' ', code_start + 1);
+        try {
+            response.status_code = std::stoi(status_line.substr(code_start + 1, code_end - code_start - 1));
+        } catch (const std::exception &) {
+            return false;
+        }
+        response.message = code_end == std::string::npos ? "" : status_line.substr(code_end + 1);
+        if (status_line.starts_with("HTTP/1.0")) {
+            response.keep_alive = false;
+        }
+
+        size_t pos = line_end == std::string::npos ? head.size() : line_end + 2;
+        while (pos < head.size()) {
+            size_t end = head.find(CARRIAGE_DELIMITER, pos);
+            if (end == std::string::npos) {
+                end = head.size();
+            }
+            const size_t colon = head.find(':', pos);
+            if (colon != std::string::npos && colon < end) {
+                const size_t value_start = head.find_first_not_of(' ', colon + 1);
+                std::string name = head.substr(pos, colon - pos);
+                std::string value = value_start < end ? head.substr(value_start, end - value_start) : "";
+                std::string lower = toLower(name);
+                if (!isHopByHopHeader(lower) && lower != "content-type") {
+                    response.headers.emplace_back(std::move(name), value);
+                }
+                headers[std::move(lower)] = std::move(value);
+            }
+            pos = end + 2;
+        }
+        return true;
+    }
+
+    static bool readChunkedBody(const int fd, const size_t max_body_bytes, std::string &buffer,
+                                UpstreamResponse &response) {
+        size_t pos = 0;
+        while (true) {
+            size_t line_end;
+            while ((line_end = buffer.find(CARRIAGE_DELIMITER, pos)) == std::string::npos) {
+                if (buffer.size() - pos > kMaxHeaderBytes) {
+                    return false; // Not a chunk-size line
+                }
+                if (readSome(fd, buffer) <= 0) {
+                    return false;
+                }
+            }
+            size_t chunk_size;
+            try {
+                chunk_size = std::stoull(buffer.substr(pos, line_end - pos), nullptr, 16);
+            } catch (const std::exception &) {
+                return false;
+            }
+            pos = line_end + 2;
+            if (chunk_size > max_body_bytes - response.body.size()) {
+                response.too_large = true;
+                return false;
+            }
+
+            if (chunk_size == 0) {
+                // Skip optional trailers up to the final empty line
+                while (buffer.find(HEADER_TERMINATOR, pos - 2) == std::string::npos) {
+                    if (readSome(fd, buffer) <= 0) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            while (buffer.size() < pos + chunk_size + 2) {
+                if (readSome(fd, buffer) <= 0) {
+                    return false;
+                }
+            }
+            response.body.append(buffer, pos, chunk_size);
+            pos += chunk_size + 2;
+        }
+    }
+};
+
+#endif //PROXY_URL_ACTION_H
@@ -0,0 +1,45 @@
+#ifndef STATS_URL_ACTION_H
+#define STATS_URL_ACTION_H
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "abstract_url_action.h"
+#include "../response/http_response.h"
+
+/**
+ * @class StatsUrlAction
+ * @brief Serves runtime metrics as plain text "name value" lines
+ *
+ * Subsystems that keep counters register a source that renders them; each
+ * request concatenates the output of every source.
+ */
+class StatsUrlAction : public AbstractUrlAction {
+public:
+    using StatsSource = std::function<std::string()>;
+
+    explicit StatsUrlAction(const std::string &resource_name)
+      : AbstractUrlAction(resource_name) {
+    }
+
+    void addSource(StatsSource source) {
+        sources_.push_back(std::move(source));
+    }
+
+    [[nodiscard]] bool empty() const {
+        return sources_.empty();
+    }
+
+    [[nodiscard]] HttpResponse execute(const HttpRequest &http_request) const override {
+        std::string body;
+        for (const StatsSource &source : sources_) {
+            body += source();
+        }
+        return HttpResponse("OK", 200, "text/plain", ResponseBody::owned(std::move(body)), http_request.headers);
+    }
+
+private:
+    std::vector<StatsSource> sources_;
+};
+
+#endif //STATS_URL_ACTION_H
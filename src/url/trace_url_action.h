@@ -0,0 +1,24 @@
+#ifndef TRACE_URL_ACTION_H
+#define TRACE_URL_ACTION_H
+#include "abstract_url_action.h"
+#include "../response/http_response.h"
+#include "../trace/tracer.h"
+
+/**
+ * @class TraceUrlAction
+ * @brief Serves the recorded request traces as Chrome trace JSON
+ */
+class TraceUrlAction : public AbstractUrlAction {
+public:
+    explicit TraceUrlAction(const std::string &resource_name)
+      : AbstractUrlAction(resource_name) {
+    }
+
+    [[nodiscard]] HttpResponse execute(const HttpRequest &http_request) const override {
+        const std::string message = "OK";
+        std::string body = Tracer::exportChromeTrace();
+        return HttpResponse(message, 200, "application/json", ResponseBody::owned(std::move(body)), http_request.headers);
+    }
+};
+
+#endif //TRACE_URL_ACTION_H
@@ -1,12 +1,19 @@
 #ifndef URL_HANDLER_H
 #define URL_HANDLER_H
+#include <chrono>
+#include <iostream>
 #include <memory>
+#include <memory_resource>
+#include <optional>
 #include <regex>
 #include <string>
+#include <unordered_map>
 
 #include "abstract_url_action.h"
 #include "not_found_url_action.h"
+#include "../cache/response_cache.h"
 #include "../request/http_request.h"
+#include "../trace/tracer.h"
 
 // Forward declaration
 struct HttpRequest;
@@ -28,52 +35,166 @@ public:
         url_map[url_name] = std::move(action);
     }
 
+    /**
+     * @brief Serve GET responses for selected URL patterns from a response cache
+     * @param cache Cache holding serialized responses
+     * @param ttls Freshness lifetime per URL pattern; patterns not listed are never cached
+     */
+    void enableCache(std::shared_ptr<ResponseCache> cache,
+                     std::unordered_map<std::string, std::chrono::milliseconds> ttls) {
+        response_cache = std::move(cache);
+        cache_ttls = std::move(ttls);
+    }
+
     /**
      * @brief Process an HTTP request and produce a response
+     *
+     * The request is updated in place with the matched parameter and directory.
+     * The response body may refer to the request, so the caller must keep the
+     * request alive until the response has been sent.
+     *
      * @param http_request The incoming HTTP request
      * @param directory_name Base directory for file operations
-     * @return Response string to send back to client
+     * @return HttpResponse Response to send back to client
+     */
+    [[nodiscard]] HttpResponse handleRequest(HttpRequest &http_request, const std::string& directory_name) const {
+        std::string param;
+        const UrlMap::value_type* route = findRoute(http_request.path, param);
+
+        if (route == nullptr) {
+            // No match found - return 404 Not Found
+            return NotFoundUrlAction("404").execute(http_request);
+        }
+
+        // Match found - update request with extracted parameters
+        http_request.request_param = std::move(param);
+        http_request.directory_name = directory_name;
+
+        const auto ttl = response_cache ? cache_ttls.find(route->first) : cache_ttls.end();
+        if (ttl == cache_ttls.end()) {
+            // Execute the matched action
+            return executeAction(*route->second, http_request);
+        }
+
+        // Key on the route and parameter rather than the raw path, so "files/a" and
+        // "files/a/" share entries and are invalidated together
+        const std::string cache_path = route->first + '/' + http_request.request_param;
+        if (http_request.method != "GET") {
+            // The action may change what GET returns; drop the cached copies afterwards
+            HttpResponse response = executeAction(*route->second, http_request);
+            response_cache->invalidate(cache_path);
+            return response;
+        }
+        return executeCached(*route->second, http_request, cache_path, ttl->second);
+    }
+
+private:
+    using UrlMap = std::pmr::unordered_map<std::string, std::shared_ptr<AbstractUrlAction>>;
+
+    /** Map of URL patterns to their handler actions */
+    UrlMap url_map;
+
+    /** Optional cache of serialized GET responses, with the TTL of each cached pattern */
+    std::shared_ptr<ResponseCache> response_cache;
+    std::unordered_map<std::string, std::chrono::milliseconds> cache_ttls;
+
+    /**
+     * @brief Find the route registered for a request path
+     * @param path Request path without the leading slash
+     * @param param Receives the part of the path after the matched pattern
+     * @return Matching pattern and action, or nullptr if no pattern matches
      */
-    [[nodiscard]] std::string sendResponseForUrl(const HttpRequest &http_request, const std::string& directory_name) const {
+    const UrlMap::value_type* findRoute(const std::string& path, std::string& param) const {
+        TraceSpan span(TracePhase::Route);
+
         // Normalize path by ensuring it ends with a slash
-        std::string url_path = http_request.path;
+        std::string url_path = path;
         if (url_path.empty() || url_path.back() != '/') {
             url_path.push_back('/');
         }
 
         // Try to match the URL against registered patterns
-        for (const auto &[pattern_key, action] : url_map) {
+        for (const auto &route : url_map) {
+            const std::string &pattern_key = route.first;
             // Create regex pattern to extract parameters
             const std::string regex_str = "^" + pattern_key + "/(.*)";
             std::regex regex_pattern(regex_str);
             std::smatch matches;
 
             if (std::regex_search(url_path, matches, regex_pattern)) {
-                // Match found - prepare request with parameters
-                HttpRequest http_request_with_params = http_request;
-
                 // Extract and process parameter
-                std::string param = matches[1];
+                param = matches[1];
                 if (!param.empty() && param.back() == '/') {
                     param.pop_back();
                 }
-
-                // Update request with extracted parameters
-                http_request_with_params.request_param = param;
-                http_request_with_params.directory_name = directory_name;
-
-                // Execute the matched action and return response
-                return action->execute(http_request_with_params).sendResponse();
+                return &route;
             }
         }
+        return nullptr;
+    }
 
-        // No match found - return 404 Not Found
-        return NotFoundUrlAction("404").execute(http_request).sendResponse();
+    /**
+     * @brief Run an action, turning an exception it throws into a 500 response
+     *
+     * Nothing above the handler catches, so an escaped exception would terminate
+     * the worker thread and with it the server.
+     */
+    static HttpResponse executeAction(const AbstractUrlAction& action, const HttpRequest& http_request) {
+        TraceSpan span(TracePhase::Execute);
+        try {
+            return action.execute(http_request);
+        } catch (const std::exception& e) {
+            std::cerr << "Action for /" << http_request.path << " failed: " << e.what() << std::endl;
+            return HttpResponse("Internal Server Error", 500, "text/plain", 0, "", http_request.headers);
+        }
     }
 
-private:
-    /** Map of URL patterns to their handler actions */
-    std::pmr::unordered_map<std::string, std::shared_ptr<AbstractUrlAction>> url_map;
+    /**
+     * @brief Serve a GET from the response cache, executing and serializing the action on a miss
+     *
+     * Variants are keyed by path, negotiated encoding and whether the client asked to
+     * close the connection, since each changes the serialized bytes. Only 200 responses
+     * are stored. A body too large to cache is not serialized at all: the response is
+     * returned as the action built it, so a file region still goes out with sendfile().
+     */
+    HttpResponse executeCached(const AbstractUrlAction& action, const HttpRequest& http_request,
+                               const std::string& cache_path, std::chrono::milliseconds ttl) const {
+        const auto connection = http_request.headers.find("Connection");
+        const bool close_connection = connection != http_request.headers.end() && connection->second == "close";
+        const std::string key = ResponseCache::makeKey(
+            cache_path, HttpResponse::negotiatedEncoding(http_request.headers), close_connection);
+
+        std::optional<HttpResponse> uncached;
+        ResponseCache::Bytes bytes = response_cache->getOrCompute(cache_path, key, ttl, [&] {
+            HttpResponse response = executeAction(action, http_request);
+            if (!response_cache->admits(response.body().size())) {
+                uncached.emplace(std::move(response));
+                return ResponseCache::Computed{nullptr, false};
+            }
+            IoBuffer serialized;
+            try {
+                TraceSpan span(TracePhase::Serialize);
+                response.writeTo(serialized);
+            } catch (const std::exception& e) {
+                // E.g. a file region shrank before it was read; answer this request without caching
+                std::cerr << "Failed to serialize /" << http_request.path << ": " << e.what() << std::endl;
+                uncached.emplace("Internal Server Error", 500, "text/plain", 0, "", http_request.headers);
+                return ResponseCache::Computed{nullptr, false};
+            }
+            return ResponseCache::Computed{
+                std::make_shared<const std::string>(serialized.readable()),
+                response.statusCode() == 200
+            };
+        });
+        if (uncached) {
+            return std::move(*uncached);
+        }
+        if (!bytes) {
+            // Waited on a miss whose response turned out too large to share, or failed
+            return executeAction(action, http_request);
+        }
+        return HttpResponse::preserialized(std::move(bytes));
+    }
 };
 
 #endif //URL_HANDLER_H
@@ -11,8 +11,8 @@ public:
 
     [[nodiscard]] HttpResponse execute(const HttpRequest &http_request) const override {
         const std::string message = "OK";
-        std::string body = http_request.headers.at("User-Agent");
-        return HttpResponse(message, 200, "text/plain", body.length(), body, http_request.headers);
+        const std::string &user_agent = http_request.headers.at("User-Agent");
+        return HttpResponse(message, 200, "text/plain", ResponseBody::view(user_agent), http_request.headers);
     }
 };
 
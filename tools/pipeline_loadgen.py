@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""Pipelining load generator for the HTTP server.
+
+Opens CONNECTIONS connections one after another. On each it sends PIPELINE
+requests in a single write, the last one with "Connection: close", and checks
+that every response is a 200. It reports the elapsed time and the TCP segments
+the host sent meanwhile (Tcp OutSegs from /proc/net/snmp; system-wide, so run
+on an otherwise idle machine).
+
+With --server, the script starts that binary itself, with tools/send_counter.c
+preloaded, and also reports how many send-family syscalls the server made. The
+shim is compiled with cc on the fly. Comparing two builds:
+
+    tools/pipeline_loadgen.py --server /path/to/old/server
+    tools/pipeline_loadgen.py --server _gate_build/server
+
+Without --server it loads a server already listening on --host/--port.
+"""
+
+import argparse
+import os
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+TOOLS_DIR = os.path.dirname(os.path.abspath(__file__))
+
+
+def tcp_out_segments():
+    with open("/proc/net/snmp") as snmp:
+        lines = [line.split() for line in snmp if line.startswith("Tcp:")]
+    header, values = lines[0], lines[1]
+    return int(values[header.index("OutSegs")])
+
+
+def run_load(host, port, path, pipeline, connections):
+    request = ("GET %s HTTP/1.1\r\nHost: %s\r\n\r\n" % (path, host)).encode()
+    last = ("GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n" % (path, host)).encode()
+    for _ in range(connections):
+        with socket.create_connection((host, port)) as client:
+            client.sendall(request * (pipeline - 1) + last)
+            received = bytearray()
+            while True:
+                chunk = client.recv(65536)
+                if not chunk:
+                    break
+                received += chunk
+        responses = received.count(b"HTTP/1.1 200")
+        if responses != pipeline:
+            sys.exit("expected %d responses, got %d" % (pipeline, responses))
+
+
+def wait_for_port(host, port, timeout=5.0):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        try:
+            socket.create_connection((host, port)).close()
+            return
+        except OSError:
+            time.sleep(0.05)
+    sys.exit("server did not start listening on %s:%d" % (host, port))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--server", help="server binary to start with the send counter preloaded")
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=4221)
+    parser.add_argument("--path", default="/echo/abc")
+    parser.add_argument("--pipeline", type=int, default=32, help="requests per connection")
+    parser.add_argument("--connections", type=int, default=200)
+    args = parser.parse_args()
+
+    server = None
+    counter_file = None
+    with tempfile.TemporaryDirectory() as scratch:
+        if args.server:
+            shim = os.path.join(scratch, "send_counter.so")
+            subprocess.run(["cc", "-shared", "-fPIC", "-O2", "-o", shim,
+                            os.path.join(TOOLS_DIR, "send_counter.c"), "-ldl"], check=True)
+            counter_file = os.path.join(scratch, "send_counter")
+            environment = dict(os.environ, LD_PRELOAD=shim, SEND_COUNTER_FILE=counter_file)
+            server = subprocess.Popen([args.server, "--listen", "%s:%d" % (args.host, args.port)],
+                                      env=environment, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        try:
+            wait_for_port(args.host, args.port)
+            run_load(args.host, args.port, args.path, args.pipeline, 5)  # Warm-up
+
+            if counter_file:
+                with open(counter_file, "r+b") as counter:
+                    counter.write(bytes(8))
+            segments_before = tcp_out_segments()
+            start = time.monotonic()
+            run_load(args.host, args.port, args.path, args.pipeline, args.connections)
+            elapsed = time.monotonic() - start
+            segments = tcp_out_segments() - segments_before
+
+            total = args.pipeline * args.connections
+            print("%d connections x %d pipelined requests: %.3f s" % (args.connections, args.pipeline, elapsed))
+            print("tcp segments sent: %d (%.2f per request)" % (segments, segments / total))
+            if counter_file:
+                with open(counter_file, "rb") as counter:
+                    sends = int.from_bytes(counter.read(8), sys.byteorder)
+                print("server send syscalls: %d (%.2f per request)" % (sends, sends / total))
+        finally:
+            if server:
+                server.terminate()
+                server.wait()
+
+
+if __name__ == "__main__":
+    main()
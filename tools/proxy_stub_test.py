@@ -0,0 +1,236 @@
+#!/usr/bin/env python3
+"""End-to-end checks for the reverse proxy against a stub upstream.
+
+Starts a small scripted upstream on an ephemeral port and the server binary
+with "--proxy api=<stub>", then sends requests through /api and checks what
+the client gets back and what the upstream saw:
+
+    - 5xx responses are passed through unchanged
+    - a POST whose exchange breaks is not replayed; an idempotent GET is
+    - chunked upstream bodies are reassembled
+    - the path remainder, trailing slash and query reach the upstream verbatim
+    - interim 1xx responses are skipped and Expect is not forwarded
+    - repeated response headers (Set-Cookie) and Location are forwarded
+    - bodies above --max-body-bytes fail with 502
+    - large bodies spliced in a pipelined batch arrive intact, and their
+      upstream connections go back to the pool afterwards
+
+Usage:
+
+    tools/proxy_stub_test.py --server _gate_build/server
+
+Exits non-zero if any check fails.
+"""
+
+import argparse
+import http.client
+import socket
+import subprocess
+import sys
+import threading
+import time
+
+MAX_BODY_BYTES = 1 << 20
+
+
+class StubUpstream:
+    """Scripted HTTP/1.1 upstream; remembers every request it receives."""
+
+    def __init__(self):
+        self.requests = []
+        self.connections = 0
+        self.lock = threading.Lock()
+        self.listener = socket.socket()
+        self.listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.listener.bind(("127.0.0.1", 0))
+        self.listener.listen(128)
+        self.port = self.listener.getsockname()[1]
+        threading.Thread(target=self.accept_loop, daemon=True).start()
+
+    def received(self, method, target):
+        with self.lock:
+            return [r for r in self.requests if r[0] == method and r[1] == target]
+
+    def accept_loop(self):
+        while True:
+            connection, _ = self.listener.accept()
+            with self.lock:
+                self.connections += 1
+                connection_id = self.connections
+            threading.Thread(target=self.serve, args=(connection, connection_id), daemon=True).start()
+
+    def serve(self, connection, connection_id):
+        buffered = b""
+        with connection:
+            while True:
+                while b"\r\n\r\n" not in buffered:
+                    try:
+                        chunk = connection.recv(65536)
+                    except ConnectionError:  # The proxy aborts exchanges it gives up on
+                        return
+                    if not chunk:
+                        return
+                    buffered += chunk
+                head, _, buffered = buffered.partition(b"\r\n\r\n")
+                lines = head.decode("latin-1").split("\r\n")
+                method, target, _ = lines[0].split(" ", 2)
+                headers = {}
+                for line in lines[1:]:
+                    name, _, value = line.partition(":")
+                    headers[name.strip().lower()] = value.strip()
+                length = int(headers.get("content-length", "0"))
+                while len(buffered) < length:
+                    buffered += connection.recv(65536)
+                body, buffered = buffered[:length], buffered[length:]
+                with self.lock:
+                    self.requests.append((method, target, headers, body, connection_id))
+                try:
+                    if not self.respond(connection, target, headers):
+                        return
+                except ConnectionError:
+                    return
+
+    @staticmethod
+    def respond(connection, target, headers):
+        """Sends the scripted response; returns False to drop the connection."""
+        status, extra, body = "200 OK", "", target.encode()
+        if target == "/status/500":
+            status, body = "500 Internal Server Error", b"upstream failed"
+        elif target == "/drop":
+            return False
+        elif target == "/chunked":
+            chunks = [b"hello ", b"chunked ", b"world"]
+            payload = b"".join(b"%x\r\n%s\r\n" % (len(c), c) for c in chunks) + b"0\r\nX-Trailer: 1\r\n\r\n"
+            connection.sendall(b"HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n"
+                               b"Transfer-Encoding: chunked\r\n\r\n" + payload)
+            return True
+        elif target == "/interim":
+            connection.sendall(b"HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 102 Processing\r\n\r\n")
+            body = b"expect=" + headers.get("expect", "-").encode()
+        elif target == "/headers":
+            status, body = "302 Found", b""
+            extra = "Location: /elsewhere\r\nSet-Cookie: a=1\r\nSet-Cookie: b=2\r\n"
+        elif target.startswith("/big/"):
+            body = b"x" * int(target[len("/big/"):])
+        connection.sendall(("HTTP/1.1 %s\r\nContent-Type: text/plain\r\n%sContent-Length: %d\r\n\r\n"
+                            % (status, extra, len(body))).encode() + body)
+        return True
+
+
+def request(port, method, target, body=None, headers=None):
+    client = http.client.HTTPConnection("127.0.0.1", port, timeout=10)
+    try:
+        client.request(method, target, body=body, headers=headers or {})
+        response = client.getresponse()
+        return response.status, response.getheaders(), response.read()
+    finally:
+        client.close()
+
+
+def wait_for_port(port, timeout=5.0):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        try:
+            socket.create_connection(("127.0.0.1", port)).close()
+            return
+        except OSError:
+            time.sleep(0.05)
+    sys.exit("server did not start listening on port %d" % port)
+
+
+def run_checks(port, stub):
+    failures = []
+
+    def check(name, condition, detail):
+        print("%s  %s" % ("ok  " if condition else "FAIL", name))
+        if not condition:
+            print("      %s" % detail)
+            failures.append(name)
+
+    status, _, body = request(port, "GET", "/api/status/500")
+    check("5xx passed through", (status, body) == (500, b"upstream failed"), (status, body))
+
+    status, _, body = request(port, "GET", "/api/chunked")
+    check("chunked body reassembled", (status, body) == (200, b"hello chunked world"), (status, body))
+
+    for target, expected in (("/api/a/b/?x=1&y=%20z", b"/a/b/?x=1&y=%20z"),
+                             ("/api/a//b", b"/a//b"),
+                             ("/api/", b"/")):
+        status, _, body = request(port, "GET", target)
+        check("forwards %s as %s" % (target, expected.decode()), (status, body) == (200, expected),
+              (status, body))
+
+    status, _, body = request(port, "POST", "/api/interim", body=b"abc",
+                              headers={"Expect": "100-continue", "Content-Type": "text/plain"})
+    check("1xx skipped, Expect dropped", (status, body) == (200, b"expect=-"), (status, body))
+
+    status, headers, _ = request(port, "GET", "/api/headers")
+    cookies = [value for name, value in headers if name.lower() == "set-cookie"]
+    location = [value for name, value in headers if name.lower() == "location"]
+    check("Location and repeated Set-Cookie forwarded",
+          status == 302 and cookies == ["a=1", "b=2"] and location == ["/elsewhere"], (status, headers))
+
+    status, _, body = request(port, "GET", "/api/big/%d" % (MAX_BODY_BYTES // 2))
+    check("body under the limit", (status, len(body)) == (200, MAX_BODY_BYTES // 2), (status, len(body)))
+    status, _, _ = request(port, "GET", "/api/big/%d" % (MAX_BODY_BYTES * 2))
+    check("body over the limit is a 502", status == 502, status)
+
+    pipelined = b"".join(b"GET /api/big/%d HTTP/1.1\r\nHost: stub\r\n\r\n" % size
+                         for size in (300000, 10, 200001)) + b"GET /api/ok HTTP/1.1\r\nHost: stub\r\nConnection: close\r\n\r\n"
+    with socket.create_connection(("127.0.0.1", port)) as client:
+        client.sendall(pipelined)
+        received = bytearray()
+        while True:
+            chunk = client.recv(65536)
+            if not chunk:
+                break
+            received += chunk
+    expected = b"".join(b"HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: %d\r\n\r\n%s" % (len(b), b)
+                        for b in (b"x" * 300000, b"x" * 10, b"x" * 200001))
+    check("pipelined spliced bodies intact", bytes(received).startswith(expected) and received.endswith(b"/ok"),
+          "got %d bytes" % len(received))
+    opened = stub.connections
+    status, _, _ = request(port, "GET", "/api/after-splice")
+    check("upstream connection reused after spliced bodies", (status, stub.connections) == (200, opened),
+          "status %d, %d new connection(s)" % (status, stub.connections - opened))
+
+    # Broken exchanges go last: they mark the only upstream down
+    status, _, _ = request(port, "POST", "/api/drop", body=b"once", headers={"Content-Type": "text/plain"})
+    sent = len(stub.received("POST", "/drop"))
+    check("POST not replayed", (status, sent) == (502, 1), "status %d, upstream saw %d" % (status, sent))
+
+    status, _, _ = request(port, "GET", "/api/drop")
+    sent = len(stub.received("GET", "/drop"))
+    check("GET retried", status == 502 and sent > 1, "status %d, upstream saw %d" % (status, sent))
+
+    status, _, body = request(port, "GET", "/api/after")
+    check("upstream still tried while marked down", (status, body) == (200, b"/after"), (status, body))
+
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--server", required=True, help="server binary to test")
+    parser.add_argument("--port", type=int, default=4221)
+    args = parser.parse_args()
+
+    stub = StubUpstream()
+    server = subprocess.Popen([args.server, "--listen", "127.0.0.1:%d" % args.port,
+                               "--proxy", "api=127.0.0.1:%d" % stub.port,
+                               "--max-body-bytes", str(MAX_BODY_BYTES)],
+                              stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        wait_for_port(args.port)
+        failures = run_checks(args.port, stub)
+    finally:
+        server.terminate()
+        server.wait()
+
+    if failures:
+        sys.exit("%d check(s) failed" % len(failures))
+    print("all checks passed")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,75 @@
+/*
+ * LD_PRELOAD shim that counts the send-family syscalls a process makes.
+ *
+ * Every send(), sendmsg(), writev() and sendfile() call increments a counter in
+ * a shared file (SEND_COUNTER_FILE, default /tmp/send_counter), so the count can
+ * be read and reset from outside while the server keeps running. Used by
+ * pipeline_loadgen.py; build with:
+ *
+ *     cc -shared -fPIC -O2 -o send_counter.so send_counter.c -ldl
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static volatile uint64_t *counter;
+
+static void count_call(void) {
+    if (counter == NULL) {
+        const char *path = getenv("SEND_COUNTER_FILE");
+        const int fd = open(path != NULL ? path : "/tmp/send_counter", O_RDWR | O_CREAT, 0644);
+        if (fd < 0 || ftruncate(fd, sizeof(uint64_t)) != 0) {
+            return;
+        }
+        void *mapped = mmap(NULL, sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            return;
+        }
+        counter = mapped;
+    }
+    __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+}
+
+ssize_t send(int fd, const void *buffer, size_t length, int flags) {
+    static ssize_t (*real)(int, const void *, size_t, int);
+    if (real == NULL) {
+        real = dlsym(RTLD_NEXT, "send");
+    }
+    count_call();
+    return real(fd, buffer, length, flags);
+}
+
+ssize_t sendmsg(int fd, const struct msghdr *message, int flags) {
+    static ssize_t (*real)(int, const struct msghdr *, int);
+    if (real == NULL) {
+        real = dlsym(RTLD_NEXT, "sendmsg");
+    }
+    count_call();
+    return real(fd, message, flags);
+}
+
+ssize_t writev(int fd, const struct iovec *segments, int count) {
+    static ssize_t (*real)(int, const struct iovec *, int);
+    if (real == NULL) {
+        real = dlsym(RTLD_NEXT, "writev");
+    }
+    count_call();
+    return real(fd, segments, count);
+}
+
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+    static ssize_t (*real)(int, int, off_t *, size_t);
+    if (real == NULL) {
+        real = dlsym(RTLD_NEXT, "sendfile");
+    }
+    count_call();
+    return real(out_fd, in_fd, offset, count);
+}